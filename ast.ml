@@ -20,6 +20,7 @@ type expr =
   | CylinderPrim
   | TetraPrim
   | ConePrim
+  | MeshLit of string (* a mesh built at compile time, by file name *)
   | Id of string
   | Binop of expr * op * expr
   | Unop of uop * expr
@@ -79,6 +80,7 @@ let rec string_of_expr = function
   | CylinderPrim -> "CYLINDER"
   | TetraPrim -> "TETRA"
   | ConePrim -> "CONE"
+  | MeshLit(f) -> "MESH(" ^ f ^ ")"
   | Id(s) -> s
   | Binop(e1, o, e2) ->
       string_of_expr e1 ^ " " ^ string_of_op o ^ " " ^ string_of_expr e2
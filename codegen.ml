@@ -33,8 +33,8 @@ let translate (globals, functions) =
   and i8_t     = L.i8_type   context
   and i1_t     = L.i1_type   context
   and void_t   = L.void_type context
-  and double_t = L.double_type context in 
-  (* and i64_t    = L.i64_type  context in *)
+  and double_t = L.double_type context
+  and i64_t    = L.i64_type  context in
   (* let i64_pt   = L.pointer_type i64_t  *)
   (* and i32_pt   = L.pointer_type i32_t  *)
   let i8_pt    = L.pointer_type i8_t in
@@ -58,6 +58,33 @@ let translate (globals, functions) =
   let system_t = L.function_type i32_t [| i8_pt |] in
   let system_func = L.declare_function "system" system_t the_module in
 
+  (* Declare the C file functions that write out embedded meshes *)
+  let fopen_t = L.function_type i8_pt [| i8_pt; i8_pt |] in
+  let fopen_func = L.declare_function "fopen" fopen_t the_module in
+  let fwrite_t = L.function_type i64_t [| i8_pt; i64_t; i64_t; i8_pt |] in
+  let fwrite_func = L.declare_function "fwrite" fwrite_t the_module in
+  let fclose_t = L.function_type i32_t [| i8_pt |] in
+  let fclose_func = L.declare_function "fclose" fclose_t the_module in
+  let rename_t = L.function_type i32_t [| i8_pt; i8_pt |] in
+  let rename_func = L.declare_function "rename" rename_t the_module in
+  let remove_t = L.function_type i32_t [| i8_pt |] in
+  let remove_func = L.declare_function "remove" remove_t the_module in
+
+  (* Meshes built at compile time (A.MeshLit), each embedded once as a
+     constant global holding the bytes of its file *)
+  let mesh_globals:(string, L.llvalue * int) Hashtbl.t = Hashtbl.create 10 in
+  let embedded_mesh f =
+    try Hashtbl.find mesh_globals f with Not_found ->
+      let ic = open_in_bin f in
+      let bytes = really_input_string ic (in_channel_length ic) in
+      close_in ic;
+      let g = L.define_global "mesh" (L.const_string context bytes) the_module in
+      L.set_global_constant true g;
+      L.set_linkage L.Linkage.Private g;
+      Hashtbl.add mesh_globals f (g, String.length bytes);
+      (g, String.length bytes)
+  in
+
   (* Declare Shapeshifter functions (need to finish enumerating) *)
 
   let shflen = 11 in (* fixed-size shape file string length *)
@@ -100,23 +127,35 @@ let translate (globals, functions) =
     ) in
     make_temp_dir;  
 
-    (* Cork executable and commands *)
+    (* Cork executable and commands.  Transforms are left pending beside
+       the shape file (cork -lazy), to be applied in one pass by whatever
+       next loads the shape; shapes are copied along with their pending
+       transforms, and saved or rendered with them applied.  A shape's
+       files are released (unlinked) once the shape is dead *)
     let get_cork_cmd func args =  
       let cork_exec = "./graphics/cork/bin/cork" 
       and render_exec = "./graphics/display/sshiftdisplay" in
 
       let cork_cmd f = 
         (match f with 
-          "Translate"         -> cork_exec ^ " -translate"
-          | "Reflect"         -> cork_exec ^ " -reflect" 
-          | "Rotate"          -> cork_exec ^ " -rotate" 
-          | "Scale"           -> cork_exec ^ " -scale" 
+          "Translate"         -> cork_exec ^ " -lazy -translate"
+          | "Reflect"         -> cork_exec ^ " -lazy -reflect" 
+          | "Rotate"          -> cork_exec ^ " -lazy -rotate" 
+          | "Scale"           -> cork_exec ^ " -lazy -scale" 
+          | "Simplify"        -> cork_exec ^ " -simplify"
+          | "Cut"             -> cork_exec ^ " -cut"
+          | "Intersects"      -> cork_exec ^ " -intersects"
+          | "Contains"        -> cork_exec ^ " -contains"
+          | "Hits"            -> cork_exec ^ " -pick"
+          | "Within"          -> cork_exec ^ " -within"
           | "Union"           -> cork_exec ^ " -union"
           | "Difference"      -> cork_exec ^ " -diff"
           | "Intersect"       -> cork_exec ^ " -isct"
-          | "Save"            -> "cp"
-          | "Copy"            -> "cp"
+          | "Save"            -> cork_exec ^ " -apply"
+          | "Copy"            -> cork_exec ^ " -copy"
+          | "Apply"           -> cork_exec ^ " -apply"
           | "Render"          -> render_exec
+          | "Release"         -> "rm -f"
           | "Xor"         -> cork_exec ^ " -xor"
           | _ -> raise (Failure "Incorrect cork_cmd")
         )
@@ -186,13 +225,31 @@ let translate (globals, functions) =
       | _ -> raise (Failure "Invalid")
     in
  
-    let build_string s n expr = 
+    let build_string s n expr builder = 
 	  let string_head = expr builder (A.StrLit s) in 
       let zero_const = L.const_int i32_t 0 in
       let str = L.build_in_bounds_gep string_head [| zero_const |] (n^"_str") builder in
       L.build_call system_func [| str |] n builder
     in
 
+    (* Write an embedded mesh to a shape's file.  As cork does, write a
+       scratch file and rename it over the shape's, so that copies which
+       share the old file keep it, and drop the old shape's pending
+       transform *)
+    let build_mesh_write f sf builder =
+      let (mesh, len) = embedded_mesh f in
+      let zero = L.const_int i32_t 0 in
+      let data = L.build_in_bounds_gep mesh [| zero; zero |] "mesh" builder in
+      let str s = L.build_global_stringptr s "" builder in
+      let scratch = str (sf ^ ".new.off") and shape = str sf in
+      let file = L.build_call fopen_func [| scratch; str "wb" |] "meshf" builder in
+      ignore (L.build_call fwrite_func [| data; L.const_int i64_t 1;
+                L.const_int i64_t len; file |] "fwritef" builder);
+      ignore (L.build_call fclose_func [| file |] "fclosef" builder);
+      ignore (L.build_call rename_func [| scratch; shape |] "renamef" builder);
+      L.build_call remove_func [| str (sf ^ ".xf") |] "removef" builder
+    in
+
     let lookup n =
       try Hashtbl.find local_vars n
       with Not_found -> StringMap.find n global_vars
@@ -306,10 +363,10 @@ let translate (globals, functions) =
       | A.Assign (s, e) -> 
         let make_prim_cmd p n =
         ( 
-          let prim_cmd = get_cork_cmd "Save" (String.concat " "
+          let prim_cmd = get_cork_cmd "Copy" (String.concat " "
                             [(get_prim_file p); 
                             (Hashtbl.find shape_map n)]) in
-          ignore (build_string prim_cmd ((string_of_expr p )^"f") expr);
+          ignore (build_string prim_cmd ((string_of_expr p )^"f") expr builder);
           (*Hashtbl.find shstr_map n*)
           L.const_int i32_t 0
         )
@@ -320,7 +377,7 @@ let translate (globals, functions) =
                             [(Hashtbl.find shape_map (string_of_expr(s1))); 
                             (Hashtbl.find shape_map (string_of_expr(s2)));
                             (Hashtbl.find shape_map n)]) in
-           ignore (build_string cmd_str (op^"f") expr);
+           ignore (build_string cmd_str (op^"f") expr builder);
            (*Hashtbl.find shstr_map n*)
            L.const_int i32_t 0   
         in
@@ -330,8 +387,13 @@ let translate (globals, functions) =
             let var_type = lookup_type id in
             (match var_type with    
             A.Shape -> 
-              let sf = Hashtbl.find shape_map id in
-              ignore (Hashtbl.add shape_map s sf);
+              (* Copy rather than alias the file, so that later changes
+                 to either shape leave the other alone; cork -copy shares
+                 the file until one of them is next written *)
+              let copy_cmd = get_cork_cmd "Copy" (String.concat " "
+                            [(Hashtbl.find shape_map id);
+                            (Hashtbl.find shape_map s)]) in
+              ignore (build_string copy_cmd "Copyf" expr builder);
               L.const_int i32_t 0
               (*Hashtbl.find shstr_map s *)
             | _ -> 
@@ -349,6 +411,10 @@ let translate (globals, functions) =
             make_prim_cmd A.SpherePrim s
           | A.TetraPrim       -> 
             make_prim_cmd A.TetraPrim s
+          (* Shapes built at compile time *)
+          | A.MeshLit f       ->
+            ignore (build_mesh_write f (Hashtbl.find shape_map s) builder);
+            L.const_int i32_t 0
           (* Boolean shape operations create a new shape*)
           | A.Call ("Union", [s1; s2]) -> 
             make_boolop_cmd "Union" s1 s2 s
@@ -396,43 +462,93 @@ let translate (globals, functions) =
                             [(Hashtbl.find shape_map (string_of_expr(s))); 
                             string_of_expr(a); string_of_expr(b); 
                             string_of_expr(c)]) in
-        build_string refle_cmd "reflf" expr;
+        build_string refle_cmd "reflf" expr builder;
       
       | A.Call ("Rotate", [s; x; y; z]) -> 
         let rotat_cmd = get_cork_cmd "Rotate" (String.concat " " 
                             [(Hashtbl.find shape_map (string_of_expr(s))); 
                             string_of_expr(x); string_of_expr(y); 
                             string_of_expr(z)]) in
-        build_string rotat_cmd "rotatef" expr;
+        build_string rotat_cmd "rotatef" expr builder;
       
       | A.Call ("Scale", [s; x; y; z]) -> 
         let scale_cmd = get_cork_cmd "Scale" (String.concat " " 
                             [(Hashtbl.find shape_map (string_of_expr(s))); 
                             string_of_expr(x); string_of_expr(y); 
                             string_of_expr(z)]) in
-        build_string scale_cmd "scalef" expr;
+        build_string scale_cmd "scalef" expr builder;
       
       | A.Call ("Translate", [s; x; y; z]) ->
         let trans_cmd = get_cork_cmd "Translate" (String.concat " " 
                             [(Hashtbl.find shape_map (string_of_expr(s))); 
                             string_of_expr(x); string_of_expr(y); 
                             string_of_expr(z)]) in
-        build_string trans_cmd "translatef" expr;
+        build_string trans_cmd "translatef" expr builder;
+      
+      | A.Call ("Simplify", [s; t]) ->
+        let simpl_cmd = get_cork_cmd "Simplify" (String.concat " " 
+                            [(Hashtbl.find shape_map (string_of_expr(s))); 
+                            string_of_expr(t)]) in
+        build_string simpl_cmd "simplifyf" expr builder;
+      
+      | A.Call ("Cut", [s; a; b; c; d]) ->
+        let cut_cmd = get_cork_cmd "Cut" (String.concat " " 
+                            [(Hashtbl.find shape_map (string_of_expr(s))); 
+                            string_of_expr(a); string_of_expr(b); 
+                            string_of_expr(c); string_of_expr(d)]) in
+        build_string cut_cmd "cutf" expr builder;
+      
+      (* cork exits with status 0 if the shapes overlap *)
+      | A.Call ("Intersects", [s1; s2]) ->
+        let isct_cmd = get_cork_cmd "Intersects" (String.concat " " 
+                            [(Hashtbl.find shape_map (string_of_expr(s1)));
+                            (Hashtbl.find shape_map (string_of_expr(s2)));
+                            "> /dev/null"]) in
+        let status = build_string isct_cmd "intersectsf" expr builder in
+        L.build_icmp L.Icmp.Eq status (L.const_int i32_t 0) "intersects" builder
+      
+      (* point queries: cork exits with status 0 if the answer is yes *)
+      | A.Call ("Contains", [s; x; y; z]) ->
+        let cont_cmd = get_cork_cmd "Contains" (String.concat " " 
+                            [(Hashtbl.find shape_map (string_of_expr(s)));
+                            string_of_expr(x); string_of_expr(y); 
+                            string_of_expr(z); "> /dev/null"]) in
+        let status = build_string cont_cmd "containsf" expr builder in
+        L.build_icmp L.Icmp.Eq status (L.const_int i32_t 0) "contains" builder
+      | A.Call ("Hits", [s; px; py; pz; dx; dy; dz]) ->
+        let hits_cmd = get_cork_cmd "Hits" (String.concat " " 
+                            [(Hashtbl.find shape_map (string_of_expr(s)));
+                            string_of_expr(px); string_of_expr(py); 
+                            string_of_expr(pz); string_of_expr(dx); 
+                            string_of_expr(dy); string_of_expr(dz); 
+                            "> /dev/null"]) in
+        let status = build_string hits_cmd "hitsf" expr builder in
+        L.build_icmp L.Icmp.Eq status (L.const_int i32_t 0) "hits" builder
+      | A.Call ("Within", [s; d; x; y; z]) ->
+        let within_cmd = get_cork_cmd "Within" (String.concat " " 
+                            [(Hashtbl.find shape_map (string_of_expr(s)));
+                            string_of_expr(d); string_of_expr(x); 
+                            string_of_expr(y); string_of_expr(z); 
+                            "> /dev/null"]) in
+        let status = build_string within_cmd "withinf" expr builder in
+        L.build_icmp L.Icmp.Eq status (L.const_int i32_t 0) "within" builder
       
       | A.Call ("Save", [s; n]) -> 
         let save_cmd = get_cork_cmd "Save" (String.concat " " 
                             [(Hashtbl.find shape_map (string_of_expr(s)));  
                             string_of_expr(n)]) in  
-        build_string save_cmd "savef" expr; 
+        build_string save_cmd "savef" expr builder; 
       | A.Call ("Copy", [s1; s2]) -> 
         let copy_cmd = get_cork_cmd "Copy" (String.concat " " 
                             [(Hashtbl.find shape_map (string_of_expr(s1)));
                             (Hashtbl.find shape_map (string_of_expr(s2)));]) in  
-        build_string copy_cmd "copyf" expr; 
+        build_string copy_cmd "copyf" expr builder; 
  
       | A.Call ("Render", [s]) -> 
-        let rend_cmd = get_cork_cmd "Render" (Hashtbl.find shape_map (string_of_expr(s))) in
-        build_string rend_cmd "rendf" expr; 
+        let sf = Hashtbl.find shape_map (string_of_expr(s)) in
+        let rend_cmd = (get_cork_cmd "Apply" sf) ^ "; " ^ 
+                       (get_cork_cmd "Render" sf) in
+        build_string rend_cmd "rendf" expr builder; 
  
       | A.Call (f, act) ->
         let (fdef, fdecl) = StringMap.find f function_decls in
@@ -521,10 +637,10 @@ let translate (globals, functions) =
                       
           let make_prim_cmd p n =
             ( 
-              let prim_cmd = get_cork_cmd "Save" (String.concat " "
+              let prim_cmd = get_cork_cmd "Copy" (String.concat " "
                             [(get_prim_file p); 
                             (Hashtbl.find shape_map n)]) in
-              ignore (build_string prim_cmd ((string_of_expr p )^"f") expr);
+              ignore (build_string prim_cmd ((string_of_expr p )^"f") expr builder);
               builder 
             )
           in   
@@ -535,7 +651,7 @@ let translate (globals, functions) =
                             [(Hashtbl.find shape_map (string_of_expr(s1))); 
                             (Hashtbl.find shape_map (string_of_expr(s2)));
                             (Hashtbl.find shape_map n)]) in
-            ignore (build_string cmd_str (op^"f") expr);
+            ignore (build_string cmd_str (op^"f") expr builder);
             builder
           in
  
@@ -551,6 +667,9 @@ let translate (globals, functions) =
               make_prim_cmd A.SpherePrim n
             | A.TetraPrim       -> 
               make_prim_cmd A.TetraPrim n
+            | A.MeshLit f       ->
+              ignore (build_mesh_write f (Hashtbl.find shape_map n) builder);
+              builder
             (* Boolean shape operations create a new shape*)
             | A.Call ("Union", [s1; s2]) -> 
               make_boolop_cmd "Union" s1 s2 n
@@ -579,9 +698,12 @@ let translate (globals, functions) =
               let variable_type = lookup_type id in
               (match variable_type with 
                 A.Shape -> 
-                  (* Set both shapes to have same file representation *)
-                  let sf = Hashtbl.find shape_map id in
-                  ignore (Hashtbl.add shape_map n sf);
+                  (* Give the new shape its own (shared until written)
+                     copy of the file, as for assignment *)
+                  let copy_cmd = get_cork_cmd "Copy" (String.concat " "
+                            [(Hashtbl.find shape_map id);
+                            (Hashtbl.find shape_map n)]) in
+                  ignore (build_string copy_cmd "Copyf" expr builder);
                   let e' = expr builder e in 
                   ignore (L.build_store e' (lookup n) builder); 
                   builder
@@ -596,8 +718,25 @@ let translate (globals, functions) =
               builder
     in
 
-    (* Build the code for each statement in the function *)
-    let builder = stmt builder (A.Block fdecl.A.body) in
+    (* Release the files of shapes that are no longer live; copies
+       share the data by hard links, so this only drops one reference *)
+    let release builder names =
+      match L.block_terminator (L.insertion_block builder) with
+        Some _ -> ()
+        | None -> List.iter (fun n ->
+            let sf = Hashtbl.find shape_map n in
+            let cmd = get_cork_cmd "Release" (sf ^ " " ^ sf ^ ".xf") in
+            let str = L.build_global_stringptr cmd "" builder in
+            ignore (L.build_call system_func [| str |] "releasef" builder)
+          ) names
+    in
+
+    (* Build the code for each statement in the function, releasing
+       each shape right after the last statement that uses it *)
+    let builder = List.fold_left (fun builder (st, dead) ->
+        let builder = stmt builder st in
+        release builder dead; builder
+      ) builder (Semant.shape_last_uses fdecl) in
 
     (* Add rm -rf .tmp command if name = main*)
     let rm_temp_dir =  
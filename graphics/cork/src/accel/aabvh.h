@@ -27,6 +27,7 @@
 
 #include "bbox.h"
 
+#include <queue>
 #include <stack>
 
 // maximum leaf size
@@ -71,6 +72,12 @@ public:
         const BBox3d                        &bbox,
         std::function<void(GeomIdx idx)>    action
     ) {
+        for_each_in_box< std::function<void(GeomIdx)> & >(bbox, action);
+    }
+    // templated visitor version of the above
+    template<class Func>
+    inline void for_each_in_box(const BBox3d &bbox, Func action)
+    {
         // do a recursive search and invoke the action at each
         // piece of geometry
         std::stack< AABVHNode<GeomIdx>* >  nodes;
@@ -95,8 +102,110 @@ public:
             }
         }
     }
-    
+
+    // walk this hierarchy and other together, invoking
+    // action(idx, other_idx) on each pair of geometry whose boxes
+    // overlap, until action returns true; returns whether it did
+    template<class Func>
+    inline bool any_overlapping_pair(AABVH &other, Func action)
+    {
+        typedef AABVHNode<GeomIdx>* Nptr;
+        std::stack< std::pair<Nptr, Nptr> > pairs;
+        pairs.push(std::make_pair(root, other.root));
+
+        while(!pairs.empty()) {
+            Nptr node       = pairs.top().first;
+            Nptr other_node = pairs.top().second;
+                              pairs.pop();
+
+            if(!hasIsct(node->bbox, other_node->bbox))  continue;
+
+            if(node->isLeaf() && other_node->isLeaf()) {
+                for(uint bid : node->blobids) {
+                    const GeomBlob<GeomIdx> &blob = blobs[bid];
+                    if(!hasIsct(blob.bbox, other_node->bbox))   continue;
+                    for(uint obid : other_node->blobids) {
+                        const GeomBlob<GeomIdx> &oblob = other.blobs[obid];
+                        if(hasIsct(blob.bbox, oblob.bbox) &&
+                           action(blob.id, oblob.id))
+                            return true;
+                    }
+                }
+            } else if(other_node->isLeaf() ||
+                      (!node->isLeaf() && len2(dim(node->bbox)) >=
+                                          len2(dim(other_node->bbox)))) {
+                // split the bigger box
+                pairs.push(std::make_pair(node->left,  other_node));
+                pairs.push(std::make_pair(node->right, other_node));
+            } else {
+                pairs.push(std::make_pair(node, other_node->left));
+                pairs.push(std::make_pair(node, other_node->right));
+            }
+        }
+        return false;
+    }
+
+    // visit geometry nearest first.  bound(bbox) gives a lower bound
+    // on the distance to anything in the box (DBL_MAX if nothing in it
+    // can matter) and action(idx) returns the distance the rest must
+    // beat to be worth visiting, so the search ends as soon as no
+    // remaining box could do better
+    template<class BoundFunc, class Func>
+    inline void nearest_first(BoundFunc bound, Func action) const
+    {
+        typedef std::pair<double, AABVHNode<GeomIdx>*> Entry;
+        std::priority_queue< Entry, std::vector<Entry>,
+                             std::greater<Entry> >  queue;
+        double limit = DBL_MAX;
+        double d = bound(root->bbox);
+        if(d < limit)   queue.push(Entry(d, root));
+        
+        while(!queue.empty()) {
+            Entry entry = queue.top();
+                          queue.pop();
+            if(entry.first >= limit)    break;
+            
+            AABVHNode<GeomIdx> *node = entry.second;
+            if(node->isLeaf()) {
+                for(uint bid : node->blobids) {
+                    if(bound(blobs[bid].bbox) < limit)
+                        limit = std::min(limit, action(blobs[bid].id));
+                }
+            } else {
+                for(AABVHNode<GeomIdx> *child : { node->left, node->right }) {
+                    d = bound(child->bbox);
+                    if(d < limit)   queue.push(Entry(d, child));
+                }
+            }
+        }
+    }
+
+    // The geometry moved but kept its order: take the new boxes and
+    // recompute the node boxes bottom up, leaving the tree as it is.
+    // After moving everything by one rigid or affine motion the tree
+    // still groups nearby geometry together (if less tightly, after a
+    // rotation), so this is a much cheaper stand-in for a rebuild
+    void refit(const std::vector< GeomBlob<GeomIdx> > &geoms)
+    {
+        ENSURE(geoms.size() == blobs.size());
+        blobs = geoms;
+        refitNode(root);
+    }
+
 private:
+    void refitNode(AABVHNode<GeomIdx> *node)
+    {
+        if(node->isLeaf()) {
+            node->bbox = BBox3d();
+            for(uint bid : node->blobids)
+                node->bbox = convex(node->bbox, blobs[bid].bbox);
+        } else {
+            refitNode(node->left);
+            refitNode(node->right);
+            node->bbox = convex(node->left->bbox, node->right->bbox);
+        }
+    }
+    
     // process range of tmpids including begin, excluding end
     // last_dim provides a hint by saying which dimension a
     // split was last made along
@@ -0,0 +1,84 @@
+// +-------------------------------------------------------------------------
+// | sweepPrune.h
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include "aabvh.h"
+
+#include <vector>
+
+// Sort-based (sweep and prune) index over boxes.  The boxes are
+// sorted by their lower bound along the axis with the largest spread.
+// A query scans the run of boxes whose lower bound is within the
+// widest box of the query's lower bound, so this works best when
+// no box is much wider than the rest.
+// Offers the same construction and query interface as AABVH
+template<class GeomIdx>
+class SweepAndPrune
+{
+public:
+    SweepAndPrune(const std::vector< GeomBlob<GeomIdx> > &geoms) :
+        blobs(geoms), max_width(0.0)
+    {
+        ENSURE(blobs.size() > 0);
+        
+        BBox3d bounds;
+        for(const GeomBlob<GeomIdx> &blob : blobs)
+            bounds = convex(bounds, blob.bbox);
+        axis = maxDim(dim(bounds));
+        
+        for(const GeomBlob<GeomIdx> &blob : blobs)
+            max_width = std::max(max_width,
+                                 blob.bbox.maxp[axis] - blob.bbox.minp[axis]);
+        
+        std::sort(blobs.begin(), blobs.end(),
+            [this](const GeomBlob<GeomIdx> &lhs,
+                   const GeomBlob<GeomIdx> &rhs) {
+                return lhs.bbox.minp[axis] < rhs.bbox.minp[axis];
+            });
+        lower.resize(blobs.size());
+        for(uint b=0; b<blobs.size(); b++)
+            lower[b] = blobs[b].bbox.minp[axis];
+    }
+    ~SweepAndPrune() {}
+    
+    template<class Func>
+    inline void for_each_in_box(const BBox3d &bbox, Func action)
+    {
+        double from = bbox.minp[axis] - max_width;
+        double to   = bbox.maxp[axis];
+        uint b = std::lower_bound(lower.begin(), lower.end(), from)
+                 - lower.begin();
+        for(; b<blobs.size() && lower[b] <= to; b++) {
+            if(hasIsct(bbox, blobs[b].bbox))
+                action(blobs[b].id);
+        }
+    }
+    
+private:
+    std::vector< GeomBlob<GeomIdx> >    blobs; // sorted along axis
+    std::vector<double>                 lower; // their lower bounds
+    uint                                axis;
+    double                              max_width;
+};
+
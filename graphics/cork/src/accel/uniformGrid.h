@@ -0,0 +1,155 @@
+// +-------------------------------------------------------------------------
+// | uniformGrid.h
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include "aabvh.h"
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// A hashed uniform grid over boxes.  Each box is binned into every
+// cell it overlaps, so this works best when the boxes are all about
+// the same size and the cells are sized to match them.
+// Offers the same construction and query interface as AABVH
+template<class GeomIdx>
+class UniformGrid
+{
+public:
+    // cell_size <= 0 uses the average of the boxes' largest extents
+    UniformGrid(
+        const std::vector< GeomBlob<GeomIdx> > &geoms,
+        double cell_size = 0.0
+    ) :
+        blobs(geoms), lo_cells(geoms.size())
+    {
+        ENSURE(blobs.size() > 0);
+        
+        if(cell_size <= 0.0) {
+            double total = 0.0;
+            for(const GeomBlob<GeomIdx> &blob : blobs)
+                total += max(dim(blob.bbox));
+            cell_size = total / blobs.size();
+        }
+        if(cell_size <= 0.0) // every box is a single point
+            cell_size = 1.0;
+        inv_cell_size = 1.0 / cell_size;
+        
+        // bin (bucket, blob) pairs and counting-sort them by bucket.
+        // Cells are hashed into a table of about twice as many buckets
+        // as there are pairs; cells which collide only cost some extra
+        // box tests, but a box hashed into the same bucket twice is
+        // only binned once
+        std::vector< std::pair<uint,uint> > entries;
+        entries.reserve(2 * blobs.size());
+        for(uint b=0; b<blobs.size(); b++) {
+            Cell lo = lo_cells[b]   = cellOf(blobs[b].bbox.minp);
+            Cell hi                 = cellOf(blobs[b].bbox.maxp);
+            for(int x=lo.x; x<=hi.x; x++)
+            for(int y=lo.y; y<=hi.y; y++)
+            for(int z=lo.z; z<=hi.z; z++)
+                entries.push_back(std::make_pair(0u, b));
+        }
+        nbuckets = 1;
+        while(nbuckets < 2 * entries.size())
+            nbuckets *= 2;
+        uint write = 0;
+        for(uint b=0; b<blobs.size(); b++) {
+            Cell lo = lo_cells[b];
+            Cell hi = cellOf(blobs[b].bbox.maxp);
+            for(int x=lo.x; x<=hi.x; x++)
+            for(int y=lo.y; y<=hi.y; y++)
+            for(int z=lo.z; z<=hi.z; z++)
+                entries[write++].first = bucket(x, y, z);
+        }
+        
+        bucket_start.assign(nbuckets + 1, 0);
+        for(const std::pair<uint,uint> &entry : entries)
+            bucket_start[entry.first + 1]++;
+        for(uint k=0; k<nbuckets; k++)
+            bucket_start[k+1] += bucket_start[k];
+        std::vector<uint> fill(bucket_start.begin(), bucket_start.end() - 1);
+        bucket_blobs.resize(entries.size());
+        for(const std::pair<uint,uint> &entry : entries) {
+            uint &end = fill[entry.first];
+            // blobs are visited in order, so a repeat would be last
+            if(end > bucket_start[entry.first] &&
+               bucket_blobs[end-1] == entry.second)     continue;
+            bucket_blobs[end++] = entry.second;
+        }
+        bucket_end.swap(fill);
+    }
+    ~UniformGrid() {}
+    
+    template<class Func>
+    inline void for_each_in_box(const BBox3d &bbox, Func action)
+    {
+        Cell lo = cellOf(bbox.minp);
+        Cell hi = cellOf(bbox.maxp);
+        for(int x=lo.x; x<=hi.x; x++)
+        for(int y=lo.y; y<=hi.y; y++)
+        for(int z=lo.z; z<=hi.z; z++) {
+            uint k = bucket(x, y, z);
+            for(uint i=bucket_start[k]; i<bucket_end[k]; i++) {
+                uint b = bucket_blobs[i];
+                // a box binned into several of the cells searched is
+                // only reported from the first of them
+                const Cell &blo = lo_cells[b];
+                if(x != std::max(lo.x, blo.x) ||
+                   y != std::max(lo.y, blo.y) ||
+                   z != std::max(lo.z, blo.z))      continue;
+                if(hasIsct(bbox, blobs[b].bbox))
+                    action(blobs[b].id);
+            }
+        }
+    }
+    
+private:
+    struct Cell {
+        int x, y, z;
+    };
+    inline Cell cellOf(const Vec3d &p) const {
+        Cell c;
+        c.x = int(std::floor(p.x * inv_cell_size));
+        c.y = int(std::floor(p.y * inv_cell_size));
+        c.z = int(std::floor(p.z * inv_cell_size));
+        return c;
+    }
+    inline uint bucket(int x, int y, int z) const {
+        uint32_t h = uint32_t(x) * 73856093u ^
+                     uint32_t(y) * 19349663u ^
+                     uint32_t(z) * 83492791u;
+        return h & (nbuckets - 1);
+    }
+private:
+    std::vector< GeomBlob<GeomIdx> >                    blobs;
+    std::vector<Cell>                                   lo_cells;
+    double                                              inv_cell_size;
+    
+    uint                                                nbuckets;
+    std::vector<uint>                                   bucket_start;
+    std::vector<uint>                                   bucket_end;
+    std::vector<uint>                                   bucket_blobs;
+};
+
@@ -0,0 +1,391 @@
+// +-------------------------------------------------------------------------
+// | bench.cpp
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+
+// Micro-benchmarks for the mesh traversal hot loops.
+//
+//      corkbench mesh.off [iterations] [remesh operation budget]
+//
+// Times Mesh::isClosed(), for_tris() through its template and its
+// std::function overload, the boolean edge cache construction
+// (BoolProblem::populateECache + for_ecache), each of the broad phase
+// structures (querying every triangle box against the edge boxes,
+// as IsctProblem does), picking with Mesh::pick() against a
+// Mesh::Query (freshly built, and refit after turning it),
+// Mesh::remesh() and transformCork() on the given mesh.  The last is
+// also checked: against the scalar reference, transformCorkScalar(), bit
+// for bit, and against the float transforms (rotateCork() and so on),
+// up to rounding.  A mismatch makes corkbench exit with status 1.
+
+#include "cork.h"
+#include "mesh.h"
+#include "files.h"
+#include "broadPhase.h"
+
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+#include <string>
+using std::string;
+#include <cstdlib>
+
+struct BenchTriangle;
+
+struct BenchVertex :
+    public MinimalVertexData,
+    public RemeshVertexData,
+    public IsctVertexData,
+    public BoolVertexData
+{
+    void merge(const BenchVertex &v0, const BenchVertex &v1) {
+        pos = 0.5 * (v0.pos + v1.pos);
+    }
+    void interpolate(const BenchVertex &v0, const BenchVertex &v1) {
+        pos = 0.5 * (v0.pos + v1.pos);
+    }
+    void isct(IsctVertEdgeTriInput<BenchVertex,BenchTriangle>) {}
+    void isct(IsctVertTriTriTriInput<BenchVertex,BenchTriangle>) {}
+    void isctInterpolate(const BenchVertex &, const BenchVertex &) {}
+};
+
+struct BenchTriangle :
+    public MinimalTriangleData,
+    public RemeshTriangleData,
+    public IsctTriangleData,
+    public BoolTriangleData
+{
+    void merge(const BenchTriangle &, const BenchTriangle &) {}
+    static void split(BenchTriangle &, BenchTriangle &,
+                      const BenchTriangle &) {}
+    void move(const BenchTriangle &) {}
+    void subdivide(SubdivideTriInput<BenchVertex,BenchTriangle> input)
+    {
+        bool_alg_data = input.pt->bool_alg_data;
+    }
+};
+
+typedef RawMesh<BenchVertex, BenchTriangle> BenchRawMesh;
+typedef Mesh<BenchVertex, BenchTriangle> BenchMesh;
+
+// build the structure and query every triangle box against it;
+// returns the number of (edge, triangle) candidate pairs found
+template<class BroadPhase>
+uint benchBroadPhase(
+    const std::vector< GeomBlob<uint> > &edge_geoms,
+    const std::vector<BBox3d>           &tri_boxes,
+    double                              *build_ms,
+    double                              *query_ms
+) {
+    Timer timer;
+    BroadPhase accel(edge_geoms);
+    *build_ms += timer.stop();
+    
+    timer.start();
+    uint npairs = 0;
+    for(const BBox3d &box : tri_boxes)
+        accel.for_each_in_box(box, [&](uint) { npairs++; });
+    *query_ms += timer.stop();
+    return npairs;
+}
+
+template<class BroadPhase>
+void reportBroadPhase(
+    const char                          *name,
+    const std::vector< GeomBlob<uint> > &edge_geoms,
+    const std::vector<BBox3d>           &tri_boxes,
+    int                                 iterations
+) {
+    double build_ms = 0.0, query_ms = 0.0;
+    uint npairs = 0;
+    for(int i=0; i<iterations; i++)
+        npairs = benchBroadPhase<BroadPhase>(edge_geoms, tri_boxes,
+                                             &build_ms, &query_ms);
+    cout << name << (build_ms / iterations) << " ms build + "
+         << (query_ms / iterations) << " ms query"
+         << " (pairs: " << npairs << ")" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        cerr << "usage: corkbench mesh.off [iterations] [remesh ops]"
+             << endl;
+        exit(1);
+    }
+    int iterations = (argc > 2)? atoi(argv[2]) : 20;
+    if(iterations < 1)  iterations = 1;
+    int remesh_ops = (argc > 3)? atoi(argv[3]) : 0;
+    if(remesh_ops < 0)  remesh_ops = 0;
+    
+    Files::FileMesh filemesh;
+    if(Files::readTriMesh(argv[1], &filemesh) > 0) {
+        cerr << "Unable to load in " << argv[1] << endl;
+        exit(1);
+    }
+    
+    BenchRawMesh raw;
+    raw.vertices.resize(filemesh.vertices.size());
+    raw.triangles.resize(filemesh.triangles.size());
+    for(uint i=0; i<raw.vertices.size(); i++)
+        raw.vertices[i].pos = filemesh.vertices[i].pos;
+    for(uint i=0; i<raw.triangles.size(); i++) {
+        raw.triangles[i].a = filemesh.triangles[i].a;
+        raw.triangles[i].b = filemesh.triangles[i].b;
+        raw.triangles[i].c = filemesh.triangles[i].c;
+    }
+    BenchMesh mesh(raw);
+    
+    // alternate the operand labels so that the edge cache sees
+    // a healthy mix of intersection and non-intersection edges
+    uint label = 0;
+    mesh.for_tris([&](BenchTriangle &tri,
+                      BenchVertex &, BenchVertex &, BenchVertex &) {
+        tri.bool_alg_data = (label++) & 1;
+    });
+    
+    cout << argv[1] << ": " << mesh.numVerts() << " verts, "
+         << mesh.numTris() << " tris, "
+         << iterations << " iterations" << endl;
+    
+    Timer timer;
+    uint closed = 0;
+    for(int i=0; i<iterations; i++)
+        closed += mesh.isClosed();
+    double ms = timer.stop();
+    cout << "isClosed:       " << (ms / iterations) << " ms/iter"
+         << " (closed: " << (closed == uint(iterations)) << ")" << endl;
+    
+    // the same light traversal through either overload of for_tris():
+    // a lambda binds to the template, which inlines it, while a
+    // std::function costs an indirect call per triangle
+    double area = 0.0;
+    auto addArea = [&](BenchTriangle &,
+                       BenchVertex &a, BenchVertex &b, BenchVertex &c) {
+        area += len(cross(b.pos - a.pos, c.pos - a.pos));
+    };
+    timer.start();
+    for(int i=0; i<iterations; i++)
+        mesh.for_tris(addArea);
+    double template_ms = timer.stop();
+    std::function<void(BenchTriangle &,
+                       BenchVertex &, BenchVertex &, BenchVertex &)>
+        addAreaFunction = addArea;
+    timer.start();
+    for(int i=0; i<iterations; i++)
+        mesh.for_tris(addAreaFunction);
+    double function_ms = timer.stop();
+    cout << "for_tris:       " << (template_ms / iterations)
+         << " ms/iter (std::function: " << (function_ms / iterations)
+         << " ms/iter, area: " << (area / (4.0 * iterations)) << ")"
+         << endl;
+    
+    timer.start();
+    uint nisct = 0;
+    for(int i=0; i<iterations; i++)
+        nisct = mesh.testingBoolEdgeCache();
+    ms = timer.stop();
+    cout << "populateECache: " << (ms / iterations) << " ms/iter"
+         << " (isct edges: " << nisct << ")" << endl;
+    
+    // broad phase over the mesh's own edges and triangles
+    std::vector< GeomBlob<uint> > edge_geoms;
+    std::vector<BBox3d> tri_boxes;
+    mesh.for_tris([&](BenchTriangle &,
+                      BenchVertex &a, BenchVertex &b, BenchVertex &c) {
+        const Vec3d *p[3] = { &a.pos, &b.pos, &c.pos };
+        for(uint k=0; k<3; k++) {
+            const Vec3d &p0 = *p[k];
+            const Vec3d &p1 = *p[(k+1)%3];
+            GeomBlob<uint> blob;
+            blob.bbox   = BBox3d(min(p0, p1), max(p0, p1));
+            blob.point  = (p0 + p1) / 2.0;
+            blob.id     = edge_geoms.size();
+            edge_geoms.push_back(blob);
+        }
+        tri_boxes.push_back(BBox3d(min(a.pos, min(b.pos, c.pos)),
+                                   max(a.pos, max(b.pos, c.pos))));
+    });
+    const char *auto_names[] = { "auto", "bvh", "grid", "sap" };
+    cout << "broad phase (auto picks "
+         << auto_names[chooseBroadPhase(edge_geoms)] << "):" << endl;
+    reportBroadPhase< AABVH<uint> >(
+        "  bvh:          ", edge_geoms, tri_boxes, iterations);
+    reportBroadPhase< UniformGrid<uint> >(
+        "  grid:         ", edge_geoms, tri_boxes, iterations);
+    reportBroadPhase< SweepAndPrune<uint> >(
+        "  sap:          ", edge_geoms, tri_boxes, iterations);
+    
+    // rays from points around the mesh towards its middle
+    const uint NRAYS = 1000;
+    BBox3d bounds;
+    for(const BBox3d &box : tri_boxes)
+        bounds = convex(bounds, box);
+    Vec3d middle = (bounds.minp + bounds.maxp) / 2.0;
+    Vec3d size = dim(bounds);
+    std::vector<Ray3d> rays(NRAYS);
+    for(Ray3d &ray : rays) {
+        for(uint k=0; k<3; k++)
+            ray.p[k] = middle[k] + drand(-1.0, 1.0) * size[k];
+        ray.r = middle - ray.p;
+    }
+    timer.start();
+    uint nhits = 0;
+    for(int i=0; i<iterations; i++) {
+        nhits = 0;
+        for(const Ray3d &ray : rays)
+            nhits += mesh.pick(ray).exists;
+    }
+    ms = timer.stop();
+    cout << "pick (linear):  " << (ms / iterations) << " ms/" << NRAYS
+         << " rays (hits: " << nhits << ")" << endl;
+    double build_ms = 0.0;
+    double query_ms = 0.0;
+    for(int i=0; i<iterations; i++) {
+        timer.start();
+        BenchMesh::Query query(mesh);
+        build_ms += timer.stop();
+        timer.start();
+        nhits = 0;
+        for(const Ray3d &ray : rays)
+            nhits += query.pick(ray).exists;
+        query_ms += timer.stop();
+    }
+    cout << "pick (query):   " << (build_ms / iterations) << " ms build + "
+         << (query_ms / iterations) << " ms/" << NRAYS
+         << " rays (hits: " << nhits << ")" << endl;
+    // moving the query by a quarter turn refits its index instead
+    const double quarter_turn[9] = { 0.0, -1.0, 0.0,
+                                     1.0,  0.0, 0.0,
+                                     0.0,  0.0, 1.0 };
+    BenchMesh::Query query(mesh);
+    double refit_ms = 0.0;
+    query_ms = 0.0;
+    for(int i=0; i<iterations; i++) {
+        timer.start();
+        query.transform(quarter_turn, Vec3d(0.0, 0.0, 0.0));
+        refit_ms += timer.stop();
+        timer.start();
+        nhits = 0;
+        for(const Ray3d &ray : rays)
+            nhits += query.pick(ray).exists;
+        query_ms += timer.stop();
+    }
+    cout << "pick (refit):   " << (refit_ms / iterations) << " ms refit + "
+         << (query_ms / iterations) << " ms/" << NRAYS
+         << " rays (hits: " << nhits << ")" << endl;
+    
+    // remesh towards edges a bit shorter than the input's average,
+    // so that there is plenty of splitting work to do
+    double total_length = 0.0;
+    mesh.for_tris([&](BenchTriangle &,
+                      BenchVertex &a, BenchVertex &b, BenchVertex &c) {
+        total_length += len(b.pos - a.pos) + len(c.pos - b.pos)
+                      + len(a.pos - c.pos);
+    });
+    double avg_length = total_length / (3.0 * mesh.numTris());
+    
+    double remesh_ms = 0.0;
+    int remesh_tris = 0;
+    for(int i=0; i<iterations; i++) {
+        BenchMesh work(raw);
+        work.remesh_options.maxEdgeLength = 0.75 * avg_length;
+        work.remesh_options.minEdgeLength = 0.3 * avg_length;
+        work.remesh_options.maxOperations = remesh_ops;
+        timer.start();
+        work.remesh();
+        remesh_ms += timer.stop();
+        remesh_tris = work.numTris();
+    }
+    cout << "remesh:         " << (remesh_ms / iterations) << " ms/iter"
+         << " (tris after: " << remesh_tris << ")" << endl;
+    
+    // rotate, scale and translate the vertices as one affine map
+    double affine[12];
+    double step[12];
+    rotateAffine(30.0f, 45.0f, 60.0f, affine);
+    scaleAffine(1.5f, 0.5f, 2.0f, step);
+    composeAffine(affine, step, affine);
+    translateAffine(0.25f, -1.0f, 3.0f, step);
+    composeAffine(affine, step, affine);
+    
+    uint nverts = filemesh.vertices.size();
+    std::vector<float> coords(3 * nverts);
+    float max_coord = 0.0f;
+    for(uint i=0; i<nverts; i++) {
+        for(uint k=0; k<3; k++) {
+            coords[3*i+k] = float(filemesh.vertices[i].pos[k]);
+            max_coord = std::max(max_coord, std::fabs(coords[3*i+k]));
+        }
+    }
+    std::vector<float> fast, scalar, eager;
+    auto asCork = [](std::vector<float> &v) {
+        CorkTriMesh cmesh;
+        cmesh.n_triangles   = 0;
+        cmesh.n_vertices    = v.size() / 3;
+        cmesh.triangles     = nullptr;
+        cmesh.vertices      = v.data();
+        return cmesh;
+    };
+    double fast_ms = 0.0, scalar_ms = 0.0;
+    for(int i=0; i<iterations; i++) {
+        fast = coords;
+        scalar = coords;
+        CorkTriMesh cfast = asCork(fast);
+        CorkTriMesh cscalar = asCork(scalar);
+        timer.start();
+        transformCork(&cfast, affine);
+        fast_ms += timer.stop();
+        timer.start();
+        transformCorkScalar(&cscalar, affine);
+        scalar_ms += timer.stop();
+    }
+    eager = coords;
+    CorkTriMesh ceager = asCork(eager);
+    rotateCork(&ceager, 30.0f, 45.0f, 60.0f);
+    scaleCork(&ceager, 1.5f, 0.5f, 2.0f);
+    translateCork(&ceager, 0.25f, -1.0f, 3.0f);
+    
+    uint mismatches = 0;
+    double max_diff = 0.0;
+    for(uint i=0; i<3*nverts; i++) {
+        mismatches += (fast[i] != scalar[i]);
+        max_diff = std::max(max_diff, double(std::fabs(fast[i] - eager[i])));
+    }
+    cout << "transform:      " << (fast_ms / iterations) << " ms/iter"
+         << " (scalar: " << (scalar_ms / iterations) << " ms/iter)" << endl;
+    cout << "  mismatches against the scalar reference: " << mismatches
+         << endl;
+    cout << "  max difference from the float transforms: " << max_diff
+         << endl;
+    // the float path rounds after each of its five 3x3 steps, each of
+    // which may scale the coordinates up by as much as 3
+    double tolerance = 1e-4 * std::max(1.0f, max_coord);
+    if(mismatches > 0 || !(max_diff <= tolerance)) {
+        cerr << "transformCork() does not match the reference" << endl;
+        return 1;
+    }
+    
+    return 0;
+}
+
@@ -106,94 +106,6 @@ struct CorkTriangle :
     }
 };
 
-// SHAPESHIFTER
-
-// Multiply a 3x3 matrix and a 3-dim vector
-void matMult3(float *mat, float *vin, float *vout) 
-{
-    vout[0] = mat[0]*vin[0] + mat[1]*vin[1] + mat[2]*vin[2]; 
-    vout[1] = mat[3]*vin[0] + mat[4]*vin[1] + mat[5]*vin[2]; 
-    vout[2] = mat[6]*vin[0] + mat[7]*vin[1] + mat[8]*vin[2]; 
-}
-
-void reflectCork(CorkTriMesh *mesh, float a, float b, float c)
-{
-    float k = 1.0f/(a*a + b*b + c*c); 
-    if (k == 0) 
-        return;
-
-    float refmat[9]; 
-    refmat[0] = k * (-a*a + b*b + c*c); 
-    refmat[1] = k * (-2.0f*a*b); 
-    refmat[2] = k * (-2.0f*a*c);
-    refmat[3] = refmat[1]; 
-    refmat[4] = k * (a*a - b*b + c*c); 
-    refmat[5] = k * (-2.0f*b*c); 
-    refmat[6] = refmat[2]; 
-    refmat[7] = refmat[5];
-    refmat[8] = k * (a*a + b*b - c*c); 
-
-    float ppos[3]; 
-    for (uint i = 0; i < mesh->n_vertices; ++i) {
-        ppos[0] = mesh->vertices[i*3]; 
-        ppos[1] = mesh->vertices[i*3+1];
-        ppos[2] = mesh->vertices[i*3+2];
-        matMult3(refmat, ppos, &(mesh->vertices[i*3])); 
-    } 
-}
-
-void rotateCork(CorkTriMesh *mesh, float x, float y, float z)
-{
-    float cosX = (float)cos(x * PI / 180.0);     
-    float sinX = (float)sin(x * PI / 180.0); 
-    float cosY = (float)cos(y * PI / 180.0);     
-    float sinY = (float)sin(y * PI / 180.0); 
-    float cosZ = (float)cos(z * PI / 180.0);     
-    float sinZ = (float)sin(z * PI / 180.0); 
-
-    float rotx[] = {1, 0, 0, 0, cosX, -sinX, 0, sinX, cosX};
-    float roty[] = {cosY, 0, sinY, 0, 1, 0, -sinY, 0, cosY};
-    float rotz[] = {cosZ, -sinZ, 0, sinZ, cosZ, 0, 0, 0, 1};
-    float ppos[3]; 
-    for (uint i = 0; i < mesh->n_vertices; ++i) {
-        ppos[0] = mesh->vertices[i*3]; 
-        ppos[1] = mesh->vertices[i*3+1];
-        ppos[2] = mesh->vertices[i*3+2];
-        matMult3(rotx, ppos, &(mesh->vertices[i*3]));
-        ppos[0] = mesh->vertices[i*3]; 
-        ppos[1] = mesh->vertices[i*3+1];
-        ppos[2] = mesh->vertices[i*3+2];
-        matMult3(roty, ppos, &(mesh->vertices[i*3]));
-        ppos[0] = mesh->vertices[i*3]; 
-        ppos[1] = mesh->vertices[i*3+1];
-        ppos[2] = mesh->vertices[i*3+2];
-        matMult3(rotz, ppos, &(mesh->vertices[i*3]));
-    } 
-}   
-
-
-void scaleCork(CorkTriMesh *mesh, float x, float y, float z)
-{
-    float scale[] = {x, 0, 0, 0, y, 0, 0, 0, z};
-    float ppos[3]; 
-    for (uint i = 0; i < mesh->n_vertices; ++i) {
-        ppos[0] = mesh->vertices[i*3]; 
-        ppos[1] = mesh->vertices[i*3+1];
-        ppos[2] = mesh->vertices[i*3+2];
-        matMult3(scale, ppos, &(mesh->vertices[i*3])); 
-    } 
-}
-void translateCork(CorkTriMesh *mesh, float x, float y, float z) 
-{
-    for (uint i = 0; i < mesh->n_vertices; ++i) {
-        mesh->vertices[i*3] += x; 
-        mesh->vertices[i*3+1] += y; 
-        mesh->vertices[i*3+2] += z; 
-    }
-}
-
-
-// END SHAPESHIFTER
 
 
 //using RawCorkMesh = RawMesh<CorkVertex, CorkTriangle>;
@@ -269,19 +181,57 @@ void corkMesh2CorkTriMesh(
 }
 
 
+CorkBoolOptions corkDefaultBoolOptions()
+{
+    BoolOptions defaults;
+    CorkBoolOptions options;
+    options.cleanSlivers    = defaults.cleanSlivers;
+    options.sliverAngle     = defaults.sliverAngle;
+    options.slivers_removed = 0;
+    options.solidInputs     = defaults.solidInputs;
+    options.validateInputs  = defaults.validateInputs;
+    options.threads         = defaults.threads;
+    options.convexKernel    = defaults.convexKernel;
+    return options;
+}
+
+void setBoolOptions(CorkMesh *mesh, const CorkBoolOptions *options)
+{
+    mesh->bool_options.cleanSlivers = options->cleanSlivers;
+    mesh->bool_options.sliverAngle  = options->sliverAngle;
+    mesh->bool_options.solidInputs  = options->solidInputs;
+    mesh->bool_options.validateInputs = options->validateInputs;
+    mesh->bool_options.threads      = options->threads;
+    mesh->bool_options.convexKernel = options->convexKernel;
+}
+
+
 bool isSolid(CorkTriMesh cmesh)
+{
+    return isSolid(cmesh, 0);
+}
+
+bool isSolid(CorkTriMesh cmesh, uint threads)
 {
     CorkMesh mesh;
     corkTriMesh2CorkMesh(cmesh, &mesh);
     
     bool solid = true;
     
-    if(mesh.isSelfIntersecting()) {
-        CORK_ERROR("isSolid() was given a self-intersecting mesh");
+    bool closed, self_intersecting, degenerate;
+    mesh.checkSolid(threads, &closed, &self_intersecting, &degenerate);
+    
+    if(self_intersecting) {
+        if(degenerate) {
+            CORK_ERROR("isSolid() found degeneracies in the mesh; "
+                       "this self-intersection might be spurious");
+        } else {
+            CORK_ERROR("isSolid() was given a self-intersecting mesh");
+        }
         solid = false;
     }
     
-    if(!mesh.isClosed()) {
+    if(!closed) {
         CORK_ERROR("isSolid() was given a non-closed mesh");
         solid = false;
     }
@@ -289,54 +239,304 @@ bool isSolid(CorkTriMesh cmesh)
     return solid;
 }
 
+bool corkIntersects(CorkTriMesh in0, CorkTriMesh in1)
+{
+    CorkMesh cmIn0, cmIn1;
+    corkTriMesh2CorkMesh(in0, &cmIn0);
+    corkTriMesh2CorkMesh(in1, &cmIn1);
+    
+    return cmIn0.intersects(cmIn1);
+}
+
+
+struct CorkQuery
+{
+    CorkQuery(const CorkMesh &mesh) : query(mesh) {}
+    CorkMesh::Query query;
+};
+
+inline Vec3d floats2Vec3d(const float *p)
+{
+    return Vec3d(p[0], p[1], p[2]);
+}
+inline void vec3d2Floats(const Vec3d &v, float *p)
+{
+    p[0] = float(v.x);
+    p[1] = float(v.y);
+    p[2] = float(v.z);
+}
+
+CorkQuery* buildCorkQuery(CorkTriMesh cmesh)
+{
+    CorkMesh mesh;
+    corkTriMesh2CorkMesh(cmesh, &mesh);
+    return new CorkQuery(mesh);
+}
+
+void freeCorkQuery(CorkQuery *query)
+{
+    delete query;
+}
+
+void transformCorkQuery(CorkQuery *query, const float *mat,
+                        const float *offset)
+{
+    double dmat[9];
+    for(uint k=0; k<9; k++)
+        dmat[k] = mat[k];
+    query->query.transform(dmat, floats2Vec3d(offset));
+}
+
+bool corkContains(CorkQuery *query, const float *point)
+{
+    return query->query.contains(floats2Vec3d(point));
+}
+
+bool corkPick(CorkQuery *query, const float *point, const float *dir,
+              float *hit, uint *tri_id)
+{
+    CorkMesh::Isct isct = query->query.pick(
+        Ray3d(floats2Vec3d(point), floats2Vec3d(dir)));
+    if(!isct.exists)
+        return false;
+    if(hit)     vec3d2Floats(isct.isct, hit);
+    if(tri_id)  *tri_id = isct.tri_id;
+    return true;
+}
+
+float corkClosestPoint(CorkQuery *query, const float *point, float *closest)
+{
+    Vec3d p = floats2Vec3d(point);
+    Vec3d q = query->query.closestPoint(p);
+    vec3d2Floats(q, closest);
+    return float(len(q - p));
+}
+
+void corkContainsN(CorkQuery *query, uint n, const float *points,
+                   bool *inside, uint threads)
+{
+    std::vector<Vec3d> ps(n);
+    for(uint k=0; k<n; k++)
+        ps[k] = floats2Vec3d(points + 3*k);
+    std::vector<char> result;
+    query->query.contains(ps, &result, threads);
+    for(uint k=0; k<n; k++)
+        inside[k] = result[k];
+}
+
+void corkPickN(CorkQuery *query, uint n, const float *points,
+               const float *dirs, bool *hit, float *hit_points, uint threads)
+{
+    std::vector<Ray3d> rays(n);
+    for(uint k=0; k<n; k++)
+        rays[k] = Ray3d(floats2Vec3d(points + 3*k), floats2Vec3d(dirs + 3*k));
+    std::vector<CorkMesh::Isct> iscts;
+    query->query.pick(rays, &iscts, threads);
+    for(uint k=0; k<n; k++) {
+        hit[k] = iscts[k].exists;
+        if(hit[k])  vec3d2Floats(iscts[k].isct, hit_points + 3*k);
+    }
+}
+
+void corkClosestPointN(CorkQuery *query, uint n, const float *points,
+                       float *closest, uint threads)
+{
+    std::vector<Vec3d> ps(n);
+    for(uint k=0; k<n; k++)
+        ps[k] = floats2Vec3d(points + 3*k);
+    std::vector<Vec3d> result;
+    query->query.closestPoint(ps, &result, threads);
+    for(uint k=0; k<n; k++)
+        vec3d2Floats(result[k], closest + 3*k);
+}
+
 void computeUnion(
     CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    computeUnion(in0, in1, out, &options);
+}
+
+void computeUnion(
+    CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+    CorkBoolOptions *options
 ) {
     CorkMesh cmIn0, cmIn1;
     corkTriMesh2CorkMesh(in0, &cmIn0);
     corkTriMesh2CorkMesh(in1, &cmIn1);
     
-    cmIn0.boolUnion(cmIn1);
+    setBoolOptions(&cmIn0, options);
+    options->slivers_removed = cmIn0.boolUnion(cmIn1);
     
     corkMesh2CorkTriMesh(&cmIn0, out);
 }
 
 void computeDifference(
     CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    computeDifference(in0, in1, out, &options);
+}
+
+void computeDifference(
+    CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+    CorkBoolOptions *options
 ) {
     CorkMesh cmIn0, cmIn1;
     corkTriMesh2CorkMesh(in0, &cmIn0);
     corkTriMesh2CorkMesh(in1, &cmIn1);
     
-    cmIn0.boolDiff(cmIn1);
+    setBoolOptions(&cmIn0, options);
+    options->slivers_removed = cmIn0.boolDiff(cmIn1);
     
     corkMesh2CorkTriMesh(&cmIn0, out);
 }
 
 void computeIntersection(
     CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    computeIntersection(in0, in1, out, &options);
+}
+
+void computeIntersection(
+    CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+    CorkBoolOptions *options
 ) {
     CorkMesh cmIn0, cmIn1;
     corkTriMesh2CorkMesh(in0, &cmIn0);
     corkTriMesh2CorkMesh(in1, &cmIn1);
     
-    cmIn0.boolIsct(cmIn1);
+    setBoolOptions(&cmIn0, options);
+    options->slivers_removed = cmIn0.boolIsct(cmIn1);
     
     corkMesh2CorkTriMesh(&cmIn0, out);
 }
 
 void computeSymmetricDifference(
     CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    computeSymmetricDifference(in0, in1, out, &options);
+}
+
+void computeSymmetricDifference(
+    CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+    CorkBoolOptions *options
 ) {
     CorkMesh cmIn0, cmIn1;
     corkTriMesh2CorkMesh(in0, &cmIn0);
     corkTriMesh2CorkMesh(in1, &cmIn1);
     
-    cmIn0.boolXor(cmIn1);
+    setBoolOptions(&cmIn0, options);
+    options->slivers_removed = cmIn0.boolXor(cmIn1);
     
     corkMesh2CorkTriMesh(&cmIn0, out);
 }
 
+void computeAllBooleans(
+    CorkTriMesh in0, CorkTriMesh in1,
+    CorkTriMesh *union_out, CorkTriMesh *diff_out,
+    CorkTriMesh *isct_out, CorkTriMesh *xor_out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    computeAllBooleans(in0, in1, union_out, diff_out, isct_out, xor_out,
+                       &options);
+}
+
+void computeAllBooleans(
+    CorkTriMesh in0, CorkTriMesh in1,
+    CorkTriMesh *union_out, CorkTriMesh *diff_out,
+    CorkTriMesh *isct_out, CorkTriMesh *xor_out,
+    CorkBoolOptions *options
+) {
+    CorkMesh cmIn0, cmIn1;
+    corkTriMesh2CorkMesh(in0, &cmIn0);
+    corkTriMesh2CorkMesh(in1, &cmIn1);
+    
+    CorkMesh cmOuts[4];
+    CorkTriMesh *outs[4] = { union_out, diff_out, isct_out, xor_out };
+    
+    setBoolOptions(&cmIn0, options);
+    options->slivers_removed = cmIn0.boolAll(cmIn1,
+        (union_out)?    &cmOuts[0] : nullptr,
+        (diff_out)?     &cmOuts[1] : nullptr,
+        (isct_out)?     &cmOuts[2] : nullptr,
+        (xor_out)?      &cmOuts[3] : nullptr);
+    
+    for(uint k=0; k<4; k++) {
+        if(outs[k])
+            corkMesh2CorkTriMesh(&cmOuts[k], outs[k]);
+    }
+}
+
+static void computeNary(
+    uint n, const CorkTriMesh *ins, CorkTriMesh *out,
+    CorkBoolOptions *options, bool intersect
+) {
+    std::vector<CorkMesh> cmIns(std::max(n, 1u));
+    for(uint k=0; k<n; k++)
+        corkTriMesh2CorkMesh(ins[k], &cmIns[k]);
+    
+    std::vector<CorkMesh*> rhs;
+    for(uint k=1; k<n; k++)
+        rhs.push_back(&cmIns[k]);
+    
+    setBoolOptions(&cmIns[0], options);
+    options->slivers_removed = (intersect)? cmIns[0].boolIsctN(rhs)
+                                          : cmIns[0].boolUnionN(rhs);
+    
+    corkMesh2CorkTriMesh(&cmIns[0], out);
+}
+
+void computeUnionN(
+    uint n, const CorkTriMesh *ins, CorkTriMesh *out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    computeUnionN(n, ins, out, &options);
+}
+
+void computeUnionN(
+    uint n, const CorkTriMesh *ins, CorkTriMesh *out,
+    CorkBoolOptions *options
+) {
+    computeNary(n, ins, out, options, false);
+}
+
+void computeIntersectionN(
+    uint n, const CorkTriMesh *ins, CorkTriMesh *out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    computeIntersectionN(n, ins, out, &options);
+}
+
+void computeIntersectionN(
+    uint n, const CorkTriMesh *ins, CorkTriMesh *out,
+    CorkBoolOptions *options
+) {
+    computeNary(n, ins, out, options, true);
+}
+
+void cutByPlane(
+    CorkTriMesh in, float a, float b, float c, float d, CorkTriMesh *out
+) {
+    CorkBoolOptions options = corkDefaultBoolOptions();
+    cutByPlane(in, a, b, c, d, out, &options);
+}
+
+void cutByPlane(
+    CorkTriMesh in, float a, float b, float c, float d, CorkTriMesh *out,
+    CorkBoolOptions *options
+) {
+    CorkMesh cmIn;
+    corkTriMesh2CorkMesh(in, &cmIn);
+    
+    setBoolOptions(&cmIn, options);
+    options->slivers_removed = cmIn.cutByPlane(Vec3d(a, b, c), d);
+    
+    corkMesh2CorkTriMesh(&cmIn, out);
+}
+
 void resolveIntersections(
     CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out
 ) {
@@ -350,3 +550,17 @@ void resolveIntersections(
     corkMesh2CorkTriMesh(&cmIn0, out);
 }
 
+// SHAPESHIFTER
+
+void simplifyCork(CorkTriMesh in, float tolerance, CorkTriMesh *out)
+{
+    CorkMesh cmIn;
+    corkTriMesh2CorkMesh(in, &cmIn);
+    
+    cmIn.simplify(tolerance);
+    
+    corkMesh2CorkTriMesh(&cmIn, out);
+}
+
+// END SHAPESHIFTER
+
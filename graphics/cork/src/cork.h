@@ -47,6 +47,32 @@ void reflectCork(CorkTriMesh *mesh, float x, float y, float z);
 void rotateCork(CorkTriMesh *mesh, float x, float y, float z); 
 void scaleCork(CorkTriMesh *mesh, float x, float y, float z); 
 void translateCork(CorkTriMesh *mesh, float x, float y, float z);
+
+// The same transforms as affine maps  x -> M x + t,  given as 12
+// numbers: each row of M followed by that row's entry of t (that is,
+// the top three rows of the 4x4 matrix, row major).  Maps compose in
+// constant time, so a run of transforms costs one pass over the mesh.
+// They are worked out in double precision, whereas the functions above
+// work in float, a 3x3 pass at a time; so a rotation or reflection
+// done either way can differ in the last bit or so of each coordinate
+void reflectAffine(float x, float y, float z, double *affine);
+void rotateAffine(float x, float y, float z, double *affine);
+void scaleAffine(float x, float y, float z, double *affine);
+void translateAffine(float x, float y, float z, double *affine);
+// out = the map doing first, then second (out may alias either)
+void composeAffine(const double *first, const double *second, double *out);
+// Applies the map to every vertex, with vector instructions where the
+// processor has them, and over several threads for large meshes.  The
+// result is bit for bit that of the plain scalar loop, kept as the
+// reference in transformCorkScalar()
+void transformCork(CorkTriMesh *mesh, const double *affine);
+void transformCorkScalar(CorkTriMesh *mesh, const double *affine);
+
+// Collapse edges wherever that moves the vertices by less than (roughly)
+// tolerance.  Output is a new mesh since the triangle count changes.
+// Note that flattened faces can still sag by more than tolerance, so
+// shells closer together than a few tolerances may end up touching.
+void simplifyCork(CorkTriMesh in, float tolerance, CorkTriMesh *out);
 // END SHAPESHIFTER
 
 // the inputs to Boolean operations must be "solid":
@@ -58,20 +84,129 @@ void translateCork(CorkTriMesh *mesh, float x, float y, float z);
 
 // This function will test whether or not a mesh is solid
 bool isSolid(CorkTriMesh mesh);
+// The closedness check and the search for self-intersections run
+// side by side, the latter spread over up to threads threads
+// (0 picks one per core)
+bool isSolid(CorkTriMesh mesh, uint threads);
+
+// Do the solids bounded by in0 and in1 overlap (or touch)?
+// Much cheaper than computing their intersection: it stops at the
+// first place the surfaces cross, and builds no result
+bool corkIntersects(CorkTriMesh in0, CorkTriMesh in1);
+
+// Repeated point and ray questions about one solid.  The mesh is
+// indexed once, when the query object is built, and each query after
+// that only visits the triangles near its answer.  The object keeps its
+// own copy of the surface; free it with freeCorkQuery().
+// Points and directions are passed as x,y,z triples
+struct CorkQuery;
+CorkQuery* buildCorkQuery(CorkTriMesh mesh);
+void freeCorkQuery(CorkQuery *query);
+
+// Move the solid, x -> mat * x + offset (mat is 3x3, row major), as
+// if the mesh had been transformed and the query built again.  The
+// index is refit to the moved triangles rather than rebuilt
+void transformCorkQuery(CorkQuery *query, const float *mat,
+                        const float *offset);
+
+// is the point inside the solid?
+bool corkContains(CorkQuery *query, const float *point);
+// the first point where the ray from point along dir meets the surface
+// (returns false if it never does).  hit and tri_id may be null
+bool corkPick(CorkQuery *query, const float *point, const float *dir,
+              float *hit, uint *tri_id);
+// the point on the surface nearest the given one; returns the distance
+float corkClosestPoint(CorkQuery *query, const float *point,
+                       float *closest);
+
+// The same for n queries at once, spread over up to threads threads
+// (0 picks one per core); points, dirs, hit_points and closest hold
+// n triples
+void corkContainsN(CorkQuery *query, uint n, const float *points,
+                   bool *inside, uint threads);
+void corkPickN(CorkQuery *query, uint n, const float *points,
+               const float *dirs, bool *hit, float *hit_points,
+               uint threads);
+void corkClosestPointN(CorkQuery *query, uint n, const float *points,
+                       float *closest, uint threads);
+
+// Boolean operations finish with a cleanup pass that collapses the
+// sliver triangles left along the intersection curve.  The pass keeps
+// closed meshes closed, and it can be tuned or turned off per call
+// by passing options; the shorter forms use corkDefaultBoolOptions()
+struct CorkBoolOptions
+{
+    bool    cleanSlivers;   // run the cleanup pass? (default: yes)
+    float   sliverAngle;    // triangles with an angle below this
+                            // many degrees are slivers (default: 5)
+    uint    slivers_removed; // OUTPUT: # of triangles the pass removed
+    bool    solidInputs;    // the inputs are solid (see isSolid()), so
+                            // only crossings between them need to be
+                            // searched for (default: no; closed inputs
+                            // are taken to be solid regardless)
+    bool    validateInputs; // also search for and resolve intersections
+                            // within each input, even where the inputs
+                            // cannot touch (default: no; slower)
+    uint    threads;        // threads for solving separate groups of
+                            // overlapping components (default: 0,
+                            // i.e. one per core)
+    bool    convexKernel;   // intersect/subtract convex operands by
+                            // plane clipping (default: yes)
+};
+CorkBoolOptions corkDefaultBoolOptions();
 
 // Boolean operations follow
 // result = A U B
 void computeUnion(CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out);
+void computeUnion(CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+                  CorkBoolOptions *options);
 
 // result = A - B
 void computeDifference(CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out);
+void computeDifference(CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+                       CorkBoolOptions *options);
 
 // result = A ^ B
 void computeIntersection(CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out);
+void computeIntersection(CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+                         CorkBoolOptions *options);
 
 // result = A XOR B
 void computeSymmetricDifference(
                         CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out);
+void computeSymmetricDifference(
+                        CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+                        CorkBoolOptions *options);
+
+// Any of the four results above, for the price of little more than one:
+// the intersections are only resolved once.  Pass null to skip a result;
+// options->slivers_removed totals the cleanup over every result
+void computeAllBooleans(CorkTriMesh in0, CorkTriMesh in1,
+                        CorkTriMesh *union_out, CorkTriMesh *diff_out,
+                        CorkTriMesh *isct_out, CorkTriMesh *xor_out);
+void computeAllBooleans(CorkTriMesh in0, CorkTriMesh in1,
+                        CorkTriMesh *union_out, CorkTriMesh *diff_out,
+                        CorkTriMesh *isct_out, CorkTriMesh *xor_out,
+                        CorkBoolOptions *options);
+
+// result = ins[0] U ins[1] U ... U ins[n-1]  (or ^ for the intersection)
+// All of the intersections are resolved together in one pass, rather
+// than re-resolving a growing result in n-1 pairwise operations
+void computeUnionN(uint n, const CorkTriMesh *ins, CorkTriMesh *out);
+void computeUnionN(uint n, const CorkTriMesh *ins, CorkTriMesh *out,
+                   CorkBoolOptions *options);
+void computeIntersectionN(uint n, const CorkTriMesh *ins, CorkTriMesh *out);
+void computeIntersectionN(uint n, const CorkTriMesh *ins, CorkTriMesh *out,
+                          CorkBoolOptions *options);
+
+// result = in minus the half-space  a*x + b*y + c*z + d > 0
+// Like subtracting a huge box, but triangles are only split along the
+// plane and the hole capped, in one pass (options->sliverAngle and
+// cleanSlivers apply)
+void cutByPlane(CorkTriMesh in, float a, float b, float c, float d,
+                CorkTriMesh *out);
+void cutByPlane(CorkTriMesh in, float a, float b, float c, float d,
+                CorkTriMesh *out, CorkBoolOptions *options);
 
 // Not a Boolean operation, but related:
 //  No portion of either surface is deleted.  However, the
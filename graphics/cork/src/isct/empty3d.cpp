@@ -37,9 +37,9 @@
 namespace Empty3d {
 
 // externalized counters...
-int degeneracy_count = 0;
-int exact_count = 0;
-int callcount = 0;
+thread_local int degeneracy_count = 0;
+thread_local int exact_count = 0;
+thread_local int callcount = 0;
 
 using namespace Ext4;
 using namespace AbsExt4;
@@ -666,6 +666,52 @@ Vec3d coordsExact(const TriTriTriIn &input)
 }
 
 
+// the differences of quantized coordinates are exact, so only the
+// cross and dot products round
+const static double COEFF_ORIENT        = 8.0*EPS + 64.0*EPS2;
+
+int orient(const TriIn &tri, const Vec3d &p)
+{
+    callcount++;
+    Vec3d e1 = tri.p[1] - tri.p[0];
+    Vec3d e2 = tri.p[2] - tri.p[0];
+    Vec3d d  = p        - tri.p[0];
+    Vec3d n  = cross(e1, e2);
+    Vec3d kn(fabs(e1.y*e2.z) + fabs(e1.z*e2.y),
+             fabs(e1.z*e2.x) + fabs(e1.x*e2.z),
+             fabs(e1.x*e2.y) + fabs(e1.y*e2.x));
+    double val      = dot(n, d);
+    double absval   = dot(kn, abs(d));
+    if(filterCheck(val, absval, COEFF_ORIENT))
+        return (val > 0.0)? 1 : -1;
+    
+    exact_count++;
+    const static int LINE_BITS       = 2*IN_BITS + 1;
+    const static int TRI_BITS        = LINE_BITS + IN_BITS + 2;
+    const static int TEST_BITS       = TRI_BITS + IN_BITS + 2;
+    
+    FixExt4_1<IN_BITS>                  tp[3];
+    FixExt4_1<IN_BITS>                  pp;
+    for(uint i=0; i<3; i++)
+        toFixExt(tp[i], tri.p[i]);
+    toFixExt(pp, p);
+    
+    FixExt4_2<LINE_BITS>                temp;
+    FixExt4_3<TRI_BITS>                 t;
+    FixExt4_1<TRI_BITS>                 plane;
+    join(temp, tp[0], tp[1]);
+    join(t,    temp,  tp[2]);
+    dual(plane, t);
+    
+    BitInt<TEST_BITS>::Rep              test;
+    inner(test, plane, pp);
+    int result = sign(test);
+    if(result == 0)
+        degeneracy_count++;
+    return result;
+}
+
+
 
 } // end namespace Empty3d
 
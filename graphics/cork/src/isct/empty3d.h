@@ -60,9 +60,15 @@ Vec3d coords(const TriTriTriIn &input);
 bool emptyExact(const TriTriTriIn &input);
 Vec3d coordsExact(const TriTriTriIn &input);
 
-extern int degeneracy_count; // count degeneracies encountered
-extern int exact_count; // count of filter calls failed
-extern int callcount; // total call count
+// which side of the plane through tri is p on?  +1 if p is on the
+// side the triangle faces (right hand rule), -1 if behind it and 0 if
+// the four points are coplanar.  Exact for quantized coordinates
+int orient(const TriIn &tri, const Vec3d &p);
+
+// (counters are per thread)
+extern thread_local int degeneracy_count; // count degeneracies encountered
+extern thread_local int exact_count; // count of filter calls failed
+extern thread_local int callcount; // total call count
 
 /*
 // exact versions
@@ -27,8 +27,8 @@
 
 namespace Quantization {
 
-double MAGNIFY = 1.0;
-double RESHRINK = 1.0;
+thread_local double MAGNIFY = 1.0;
+thread_local double RESHRINK = 1.0;
 
 } // end namespace Quantization
 
@@ -32,8 +32,9 @@ namespace Quantization {
 // NOTE: none of these values should be modified by the clients
 static const int BITS = 30;
 // MAGNIFY * RESHRINK == 1
-extern double MAGNIFY;
-extern double RESHRINK;
+// (per thread, so that independent problems can run concurrently)
+extern thread_local double MAGNIFY;
+extern thread_local double RESHRINK;
 inline int quantize2int(double number) {
     return int(number * MAGNIFY);
 }
@@ -36,12 +36,16 @@ using std::cerr;
 using std::endl;
 #include <sstream>
 using std::stringstream;
+#include <fstream>
 using std::string;
 
 using std::ostream;
 #include <stdlib.h>
+#include <unistd.h>
+#include <cmath>
 
 #include "cork.h"
+#include "parallel.h"
 
 
 void file2corktrimesh(
@@ -85,6 +89,97 @@ void corktrimesh2file(
     }
 }
 
+// SHAPESHIFTER
+// Shape files are copied on write.  -copy makes the copy another name
+// for the same file (a hard link), which costs nothing however big the
+// mesh; and files are never written over in place, but written afresh
+// and renamed over the old name.  That detaches the name being written
+// from any others sharing the file, and once the last name is gone the
+// file goes with it
+string scratchFile(const string &filename)
+{
+    // keep the suffix, which picks the file format
+    size_t lastdot = filename.find_last_of('.');
+    if(lastdot == string::npos)
+        return filename + ".new";
+    return filename + ".new" + filename.substr(lastdot);
+}
+
+void replaceFile(const string &scratch, const string &filename)
+{
+    if(rename(scratch.c_str(), filename.c_str()) != 0) {
+        cerr << "Unable to write to " << filename << endl;
+        remove(scratch.c_str());
+        exit(1);
+    }
+    // renaming a file over another name for itself does nothing
+    remove(scratch.c_str());
+}
+
+// make to another name for from, or failing that, a copy of it
+bool shareFile(const string &from, const string &to)
+{
+    string scratch = scratchFile(to);
+    remove(scratch.c_str());
+    if(link(from.c_str(), scratch.c_str()) != 0) {
+        std::ifstream src(from.c_str(), std::ios::binary);
+        if(!src)
+            return false;
+        std::ofstream dst(scratch.c_str(), std::ios::binary);
+        dst << src.rdbuf();
+        if(!dst)
+            return false;
+    }
+    replaceFile(scratch, to);
+    return true;
+}
+
+// A transform can be left pending on a mesh file (see -lazy): its
+// affine map is kept in a small file beside the mesh, in.off.xf, and
+// applied whenever the mesh is next loaded.  Writing a mesh file
+// discards whatever was pending on it
+string pendingFile(const string &filename)
+{
+    return filename + ".xf";
+}
+
+bool loadPending(const string &filename, double *affine)
+{
+    std::ifstream in(pendingFile(filename).c_str());
+    if(!in)
+        return false;
+    for(uint k=0; k<12; k++) {
+        if(!(in >> affine[k])) {
+            cerr << "Unable to read the transform pending on "
+                 << filename << endl;
+            exit(1);
+        }
+    }
+    return true;
+}
+
+void savePending(const string &filename, const double *affine)
+{
+    string scratch = scratchFile(pendingFile(filename));
+    std::ofstream out(scratch.c_str());
+    out.precision(17);
+    for(uint k=0; k<12; k++)
+        out << affine[k] << ((k%4 == 3)? '\n' : ' ');
+    out.close();
+    if(!out) {
+        cerr << "Unable to write to " << pendingFile(filename) << endl;
+        remove(scratch.c_str());
+        exit(1);
+    }
+    replaceFile(scratch, pendingFile(filename));
+}
+
+void clearPending(const string &filename)
+{
+    remove(pendingFile(filename).c_str());
+}
+// END SHAPESHIFTER
+
 void loadMesh(string filename, CorkTriMesh *out)
 {
     Files::FileMesh filemesh;
@@ -95,6 +190,10 @@ void loadMesh(string filename, CorkTriMesh *out)
     }
     
     file2corktrimesh(filemesh, out);
+    
+    double affine[12];
+    if(loadPending(filename, affine))
+        transformCork(out, affine);
 }
 void saveMesh(string filename, CorkTriMesh in)
 {
@@ -102,10 +201,14 @@ void saveMesh(string filename, CorkTriMesh in)
     
     corktrimesh2file(in, filemesh);
     
-    if(Files::writeTriMesh(filename, &filemesh) > 0) {
+    string scratch = scratchFile(filename);
+    if(Files::writeTriMesh(scratch, &filemesh) > 0) {
         cerr << "Unable to write to " << filename << endl;
+        remove(scratch.c_str());
         exit(1);
     }
+    replaceFile(scratch, filename);
+    clearPending(filename);
 }
 
 
@@ -243,6 +346,148 @@ genericBinaryOp(
 }
 
 
+// SHAPESHIFTER
+// options for the Boolean commands;
+// -slivers, -validate, -solid-inputs and -threads change them for all
+// of the commands that follow
+static CorkBoolOptions bool_options = corkDefaultBoolOptions();
+static bool report_slivers = false;
+// the status cork exits with; -intersects and the point queries set it
+static int exit_status = 0;
+
+std::function< void(
+    std::vector<string>::iterator &,
+    const std::vector<string>::iterator &
+) >
+genericBoolOp(
+    void (*boolop)(CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out,
+                   CorkBoolOptions *options)
+) {
+    return genericBinaryOp([boolop]
+    (CorkTriMesh in0, CorkTriMesh in1, CorkTriMesh *out) {
+        boolop(in0, in1, out, &bool_options);
+        if(report_slivers)
+            cout << "removed " << bool_options.slivers_removed
+                 << " sliver triangles" << endl;
+    });
+}
+
+// out in0 in1 ... (the inputs run up to the next command)
+std::function< void(
+    std::vector<string>::iterator &,
+    const std::vector<string>::iterator &
+) >
+genericNaryOp(
+    void (*naryop)(uint n, const CorkTriMesh *ins, CorkTriMesh *out,
+                   CorkBoolOptions *options)
+) {
+    return [naryop]
+    (std::vector<string>::iterator &args,
+     const std::vector<string>::iterator &end) {
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        string outname = *args;
+        args++;
+        
+        std::vector<CorkTriMesh> ins;
+        while(args != end && (*args)[0] != '-') {
+            ins.push_back(CorkTriMesh());
+            loadMesh(*args, &ins.back());
+            args++;
+        }
+        if(ins.size() < 2) { cerr << "too few args" << endl; exit(1); }
+        
+        CorkTriMesh out;
+        naryop(ins.size(), ins.data(), &out, &bool_options);
+        if(report_slivers)
+            cout << "removed " << bool_options.slivers_removed
+                 << " sliver triangles" << endl;
+        
+        saveMesh(outname, out);
+        freeCorkTriMesh(&out);
+        
+        for(CorkTriMesh &in : ins) {
+            delete[] in.vertices;
+            delete[] in.triangles;
+        }
+    };
+}
+
+// transforms are applied to in and written back, unless -lazy was
+// given, in which case their maps pile up in the pending file instead
+static bool lazy_transforms = false;
+
+// in x y z
+std::function< void(
+    std::vector<string>::iterator &,
+    const std::vector<string>::iterator &
+) >
+genericTransformOp(
+    string name,
+    void (*transform)(CorkTriMesh *mesh, float x, float y, float z),
+    void (*affine)(float x, float y, float z, double *affine)
+) {
+    return [name, transform, affine]
+    (std::vector<string>::iterator &args,
+     const std::vector<string>::iterator &end) {
+        if(args == end) { cerr << "too few args for " << name << endl;
+                          exit(1); }
+        string filename = *args;
+        args++;
+        
+        float xyz[3];
+        for(uint k=0; k<3; k++) {
+            if(args == end) { cerr << "too few args for " << name << endl;
+                              exit(1); }
+            xyz[k] = strtof((*args).c_str(), NULL);
+            args++;
+        }
+        
+        if(lazy_transforms) {
+            double pending[12];
+            double step[12];
+            affine(xyz[0], xyz[1], xyz[2], step);
+            if(loadPending(filename, pending))
+                composeAffine(pending, step, step);
+            savePending(filename, step);
+        } else {
+            CorkTriMesh in;
+            loadMesh(filename, &in);
+            transform(&in, xyz[0], xyz[1], xyz[2]);
+            saveMesh(filename, in);
+            delete[] in.vertices;
+            delete[] in.triangles;
+        }
+    };
+}
+
+// x y z triples, up to the next argument that is not a number
+// (so negative coordinates are not taken for commands)
+void readPoints(std::vector<string>::iterator &args,
+                const std::vector<string>::iterator &end,
+                std::vector<float> *coords)
+{
+    while(args != end) {
+        const char *str = (*args).c_str();
+        char *rest;
+        float x = strtof(str, &rest);
+        if(rest == str || *rest != '\0')
+            break;
+        coords->push_back(x);
+        args++;
+    }
+    if(coords->empty() || coords->size() % 3 != 0) {
+        cerr << "points need three coordinates each" << endl;
+        exit(1);
+    }
+}
+
+ostream& printPoint(ostream &out, const float *p)
+{
+    return out << p[0] << " " << p[1] << " " << p[2];
+}
+// END SHAPESHIFTER
+
+
 int main(int argc, char *argv[])
 {
     initRand(); // that's useful
@@ -266,9 +511,103 @@ int main(int argc, char *argv[])
     
     // add cmds
     cmds.regCmd("solid",
-    "-solid in              Determine whether the input mesh represents\n"
+    "-solid in0 in1 ...     Determine whether each input mesh represents\n"
     "                       a solid object.  (aka. watertight) (technically\n"
-    "                       solid == closed and non-self-intersecting)",
+    "                       solid == closed and non-self-intersecting)\n"
+    "                       Several meshes are checked concurrently",
+    [](std::vector<string>::iterator &args,
+       const std::vector<string>::iterator &end) {
+        std::vector<string> filenames;
+        while(args != end && (*args)[0] != '-') {
+            filenames.push_back(*args);
+            args++;
+        }
+        if(filenames.empty()) { cerr << "too few args" << endl; exit(1); }
+        
+        // one mesh per thread, unless there is only the one
+        uint nfiles = filenames.size();
+        std::vector<char> solid(nfiles);
+        parallel_for(nfiles, bool_options.threads, [&](uint k) {
+            CorkTriMesh in;
+            loadMesh(filenames[k], &in);
+            solid[k] = isSolid(in, (nfiles > 1)? 1 : bool_options.threads);
+            delete[] in.vertices;
+            delete[] in.triangles;
+        });
+        
+        for(uint k=0; k<nfiles; k++) {
+            cout << "The mesh " << filenames[k] << " is: " << endl;
+            cout << "    " << ((solid[k])? "SOLID" : "NOT SOLID") << endl;
+        }
+    });
+
+    // SHAPESHIFTER
+
+    cmds.regCmd("intersects",
+    "-intersects in0 in1    Determine whether the solids in0 and in1\n"
+    "                       overlap, without computing their intersection;\n"
+    "                       cork exits with status 1 if they do not",
+    [](std::vector<string>::iterator &args,
+       const std::vector<string>::iterator &end) {
+        CorkTriMesh in0;
+        CorkTriMesh in1;
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        string filename0 = *args;
+        loadMesh(*args, &in0);
+        args++;
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        string filename1 = *args;
+        loadMesh(*args, &in1);
+        args++;
+
+        bool overlap = corkIntersects(in0, in1);
+        cout << "The meshes " << filename0 << " and " << filename1
+             << " are: " << endl;
+        cout << "    " << ((overlap)? "INTERSECTING" : "NOT INTERSECTING")
+             << endl;
+        exit_status = (overlap)? 0 : 1;
+
+        delete[] in0.vertices;
+        delete[] in0.triangles;
+        delete[] in1.vertices;
+        delete[] in1.triangles;
+    });
+
+    cmds.regCmd("contains",
+    "-contains in x y z ... Determine whether each point lies inside the\n"
+    "                       solid in; cork exits with status 1 if any\n"
+    "                       of them does not",
+    [](std::vector<string>::iterator &args,
+       const std::vector<string>::iterator &end) {
+        CorkTriMesh in;
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        loadMesh(*args, &in);
+        args++;
+        std::vector<float> points;
+        readPoints(args, end, &points);
+        
+        uint n = points.size() / 3;
+        CorkQuery *query = buildCorkQuery(in);
+        bool *inside = new bool[n];
+        corkContainsN(query, n, points.data(), inside, bool_options.threads);
+        for(uint k=0; k<n; k++) {
+            cout << "The point ";
+            printPoint(cout, &points[3*k]) << " is: " << endl;
+            cout << "    " << ((inside[k])? "INSIDE" : "OUTSIDE") << endl;
+            if(!inside[k])
+                exit_status = 1;
+        }
+        
+        delete[] inside;
+        freeCorkQuery(query);
+        delete[] in.vertices;
+        delete[] in.triangles;
+    });
+    cmds.regCmd("pick",
+    "-pick in px py pz dx dy dz\n"
+    "                       Find where the ray from p along d first meets\n"
+    "                       the surface of in; cork exits with status 1\n"
+    "                       if it never does",
     [](std::vector<string>::iterator &args,
        const std::vector<string>::iterator &end) {
         CorkTriMesh in;
@@ -276,164 +615,364 @@ int main(int argc, char *argv[])
         string filename = *args;
         loadMesh(*args, &in);
         args++;
+        std::vector<float> ray;
+        readPoints(args, end, &ray);
+        if(ray.size() != 6) { cerr << "a ray is a point and a direction"
+                                   << endl; exit(1); }
         
-        bool solid = isSolid(in);
-        cout << "The mesh " << filename << " is: " << endl;
-        cout << "    " << ((solid)? "SOLID" : "NOT SOLID") << endl;
+        CorkQuery *query = buildCorkQuery(in);
+        float hit[3];
+        uint  tri_id;
+        if(corkPick(query, &ray[0], &ray[3], hit, &tri_id)) {
+            cout << "The ray meets " << filename << " at: " << endl;
+            printPoint(cout << "    ", hit) << " (triangle " << tri_id << ")"
+                                            << endl;
+        } else {
+            cout << "The ray misses " << filename << endl;
+            exit_status = 1;
+        }
         
+        freeCorkQuery(query);
         delete[] in.vertices;
         delete[] in.triangles;
     });
-
-    // SHAPESHIFTER
-
-    cmds.regCmd("translate", 
-    "-translate in x y z    Translate the input shape by x,y,z and \n"
-    "                       and write the result back to the same file", 
-    [](std::vector<string>::iterator &args, 
+    cmds.regCmd("closest",
+    "-closest in x y z ...  Find the point on the surface of in nearest\n"
+    "                       each point, and how far away it is",
+    [](std::vector<string>::iterator &args,
+       const std::vector<string>::iterator &end) {
+        CorkTriMesh in;
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        loadMesh(*args, &in);
+        args++;
+        std::vector<float> points;
+        readPoints(args, end, &points);
+        
+        uint n = points.size() / 3;
+        CorkQuery *query = buildCorkQuery(in);
+        std::vector<float> closest(points.size());
+        corkClosestPointN(query, n, points.data(), closest.data(),
+                          bool_options.threads);
+        for(uint k=0; k<n; k++) {
+            float d[3];
+            for(uint j=0; j<3; j++)
+                d[j] = closest[3*k+j] - points[3*k+j];
+            cout << "The surface point nearest ";
+            printPoint(cout, &points[3*k]) << " is: " << endl;
+            printPoint(cout << "    ", &closest[3*k])
+                << " (distance "
+                << std::sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]) << ")"
+                << endl;
+        }
+        
+        freeCorkQuery(query);
+        delete[] in.vertices;
+        delete[] in.triangles;
+    });
+    cmds.regCmd("within",
+    "-within in d x y z ... Determine whether each point lies within\n"
+    "                       distance d of the surface of in; cork exits\n"
+    "                       with status 1 if any of them does not",
+    [](std::vector<string>::iterator &args,
+       const std::vector<string>::iterator &end) {
+        CorkTriMesh in;
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        loadMesh(*args, &in);
+        args++;
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        float dist = strtof((*args).c_str(), NULL);
+        args++;
+        std::vector<float> points;
+        readPoints(args, end, &points);
+        
+        CorkQuery *query = buildCorkQuery(in);
+        for(uint k=0; k<points.size()/3; k++) {
+            float closest[3];
+            bool within = corkClosestPoint(query, &points[3*k], closest)
+                          <= dist;
+            cout << "The point ";
+            printPoint(cout, &points[3*k]) << " is: " << endl;
+            cout << "    " << ((within)? "WITHIN " : "NOT WITHIN ")
+                 << dist << endl;
+            if(!within)
+                exit_status = 1;
+        }
+        
+        freeCorkQuery(query);
+        delete[] in.vertices;
+        delete[] in.triangles;
+    });
+    cmds.regCmd("lazy",
+    "-lazy                  Have each following transform leave its map\n"
+    "                       pending in in.xf, beside the input file,\n"
+    "                       rather than rewriting the mesh; a run of\n"
+    "                       transforms then costs a single pass over the\n"
+    "                       vertices, made by the next command to load it",
+    [](std::vector<string>::iterator &,
+        const std::vector<string>::iterator &) {
+        lazy_transforms = true;
+    });
+    cmds.regCmd("apply",
+    "-apply in [out]        Apply any transform pending on the input\n"
+    "                       shape, and write the result back to the same\n"
+    "                       file (or to out)",
+    [](std::vector<string>::iterator &args,
         const std::vector<string>::iterator &end) {
-        CorkTriMesh in; 
-        if(args == end) { cerr << "too few args for translate" << endl; exit(1); }
-        string filename = *args; 
-        loadMesh(*args, &in); 
-        args++; 
-    
-        float x, y, z; 
-        if(args == end) { cerr << "too few args for translate" << endl; exit(1); }
-        x = strtof((*args).c_str(), NULL);
+        CorkTriMesh in;
+        if(args == end) { cerr << "too few args for apply" << endl; exit(1); }
+        string filename = *args;
+        args++;
+        if(args != end && (*args)[0] != '-') {
+            loadMesh(filename, &in);
+            saveMesh(*args, in);
+            args++;
+        } else {
+            double affine[12];
+            if(!loadPending(filename, affine))
+                return;
+            loadMesh(filename, &in);
+            saveMesh(filename, in);
+        }
+        delete[] in.vertices;
+        delete[] in.triangles;
+    });
+    cmds.regCmd("copy",
+    "-copy in out           Copy the input shape to out, along with any\n"
+    "                       transform pending on it.  The copy shares the\n"
+    "                       file until either one is next written",
+    [](std::vector<string>::iterator &args,
+        const std::vector<string>::iterator &end) {
+        if(args == end) { cerr << "too few args for copy" << endl; exit(1); }
+        string filename = *args;
         args++;
-        if(args == end) { cerr << "too few args for translate" << endl; exit(1); }
-        y = strtof((*args).c_str(), NULL);
-        args++; 
-        if(args == end) { cerr << "too few args for translate" << endl; exit(1); }
-        z = strtof((*args).c_str(), NULL);
+        if(args == end) { cerr << "too few args for copy" << endl; exit(1); }
+        string outname = *args;
         args++;
- 
-        translateCork(&in, x, y, z);  
-
-        saveMesh(filename, in);
-        delete[] in.vertices; 
-        delete[] in.triangles;         
-    });    
+        if(outname == filename)
+            return;
+        
+        if(!shareFile(filename, outname)) {
+            cerr << "Unable to copy " << filename << " to " << outname << endl;
+            exit(1);
+        }
+        if(!shareFile(pendingFile(filename), pendingFile(outname)))
+            clearPending(outname);
+    });
+    cmds.regCmd("translate", 
+    "-translate in x y z    Translate the input shape by x,y,z and \n"
+    "                       and write the result back to the same file", 
+    genericTransformOp("translate", translateCork, translateAffine));    
 
     cmds.regCmd("reflect", 
     "-reflect in a b c      Reflect the input shape across the plane \n"
     "                       defined by ax + by + cz = 0 \n"
     "                       and write the result back to the same file", 
-    [](std::vector<string>::iterator &args, 
-        const std::vector<string>::iterator &end) {
-        CorkTriMesh in; 
-        if(args == end) { cerr << "too few args for reflect" << endl; exit(1); }
-        string filename = *args; 
-        loadMesh(*args, &in); 
-        args++; 
-    
-        float x, y, z; 
-        if(args == end) { cerr << "too few args for reflect" << endl; exit(1); }
-        x = strtof((*args).c_str(), NULL);
-        args++;
-        if(args == end) { cerr << "too few args for reflect" << endl; exit(1); }
-        y = strtof((*args).c_str(), NULL);
-        args++; 
-        if(args == end) { cerr << "too few args for reflect" << endl; exit(1); }
-        z = strtof((*args).c_str(), NULL);
-        args++;
- 
-        reflectCork(&in, x, y, z);  
-
-        saveMesh(filename, in);
-        delete[] in.vertices; 
-        delete[] in.triangles; 
-    });    
+    genericTransformOp("reflect", reflectCork, reflectAffine));    
 
     cmds.regCmd("rotate", 
     "-rotate in x y z       Rotate the input shape around the\n"
     "                       x, y, and z axes and write the result\n"
     "                       back to the same file", 
-    [](std::vector<string>::iterator &args, 
+    genericTransformOp("rotate", rotateCork, rotateAffine));    
+
+    cmds.regCmd("scale", 
+    "-scale in x y z        Scale the input shape by x,y,z and \n"
+    "                       and write the result back to the same file", 
+    genericTransformOp("scale", scaleCork, scaleAffine));    
+
+    cmds.regCmd("simplify",
+    "-simplify in tol       Collapse edges of the input shape wherever that\n"
+    "                       moves the surface by less than about tol,\n"
+    "                       and write the result back to the same file",
+    [](std::vector<string>::iterator &args,
         const std::vector<string>::iterator &end) {
-        CorkTriMesh in; 
-        if(args == end) { cerr << "too few args for rotate" << endl; exit(1); }
-        string filename = *args; 
-        loadMesh(*args, &in); 
-        args++; 
-    
-        float x, y, z; 
-        if(args == end) { cerr << "too few args for rotate" << endl; exit(1); }
-        x = strtof((*args).c_str(), NULL);
+        CorkTriMesh in;
+        CorkTriMesh out;
+        if(args == end) { cerr << "too few args for simplify" << endl; exit(1); }
+        string filename = *args;
+        loadMesh(*args, &in);
         args++;
-        if(args == end) { cerr << "too few args for rotate" << endl; exit(1); }
-        y = strtof((*args).c_str(), NULL);
-        args++; 
-        if(args == end) { cerr << "too few args for rotate" << endl; exit(1); }
-        z = strtof((*args).c_str(), NULL);
+
+        if(args == end) { cerr << "too few args for simplify" << endl; exit(1); }
+        float tolerance = strtof((*args).c_str(), NULL);
         args++;
- 
-        rotateCork(&in, x, y, z);  
 
-        saveMesh(filename, in);
-        delete[] in.vertices; 
-        delete[] in.triangles;         
-    });    
+        simplifyCork(in, tolerance, &out);
 
-    cmds.regCmd("scale", 
-    "-scale in x y z        Scale the input shape by x,y,z and \n"
-    "                       and write the result back to the same file", 
-    [](std::vector<string>::iterator &args, 
+        saveMesh(filename, out);
+        freeCorkTriMesh(&out);
+        delete[] in.vertices;
+        delete[] in.triangles;
+    });
+
+    cmds.regCmd("cut",
+    "-cut in a b c d        Cut away the part of the input shape where\n"
+    "                       ax + by + cz + d > 0, close the cut with a\n"
+    "                       flat cap, and write the result back to the\n"
+    "                       same file",
+    [](std::vector<string>::iterator &args,
         const std::vector<string>::iterator &end) {
-        CorkTriMesh in; 
-        if(args == end) { cerr << "too few args for scale" << endl; exit(1); }
-        string filename = *args; 
-        loadMesh(*args, &in); 
-        args++; 
-    
-        float x, y, z; 
-        if(args == end) { cerr << "too few args for scale" << endl; exit(1); }
-        x = strtof((*args).c_str(), NULL);
+        CorkTriMesh in;
+        CorkTriMesh out;
+        if(args == end) { cerr << "too few args for cut" << endl; exit(1); }
+        string filename = *args;
+        loadMesh(*args, &in);
         args++;
-        if(args == end) { cerr << "too few args for scale" << endl; exit(1); }
-        y = strtof((*args).c_str(), NULL);
-        args++; 
-        if(args == end) { cerr << "too few args for scale" << endl; exit(1); }
-        z = strtof((*args).c_str(), NULL);
+
+        float plane[4];
+        for(uint k=0; k<4; k++) {
+            if(args == end) { cerr << "too few args for cut" << endl; exit(1); }
+            plane[k] = strtof((*args).c_str(), NULL);
+            args++;
+        }
+
+        cutByPlane(in, plane[0], plane[1], plane[2], plane[3],
+                   &out, &bool_options);
+        if(report_slivers)
+            cout << "removed " << bool_options.slivers_removed
+                 << " sliver triangles" << endl;
+
+        saveMesh(filename, out);
+        freeCorkTriMesh(&out);
+        delete[] in.vertices;
+        delete[] in.triangles;
+    });
+
+    cmds.regCmd("slivers",
+    "-slivers deg           Clean up triangles with an angle below deg\n"
+    "                       degrees after each following Boolean command,\n"
+    "                       and report how many were removed (0 turns\n"
+    "                       the cleanup off, and reports nothing)",
+    [](std::vector<string>::iterator &args,
+        const std::vector<string>::iterator &end) {
+        if(args == end) { cerr << "too few args for slivers" << endl; exit(1); }
+        float angle = strtof((*args).c_str(), NULL);
         args++;
- 
-        scaleCork(&in, x, y, z);  
 
-        saveMesh(filename, in);
-        delete[] in.vertices; 
-        delete[] in.triangles;         
-    });    
+        bool_options.cleanSlivers = (angle > 0.0f);
+        bool_options.sliverAngle = angle;
+        report_slivers = bool_options.cleanSlivers;
+    });
+
+    cmds.regCmd("validate",
+    "-validate              Have each following Boolean command also find\n"
+    "                       and resolve self-intersections within its\n"
+    "                       inputs, even closed ones, which are otherwise\n"
+    "                       taken to have none (slower)",
+    [](std::vector<string>::iterator &,
+        const std::vector<string>::iterator &) {
+        bool_options.validateInputs = true;
+    });
+
+    cmds.regCmd("solid-inputs",
+    "-solid-inputs          Have each following Boolean command trust that\n"
+    "                       its inputs are solid (see -solid), closed or\n"
+    "                       not, and search only for crossings between\n"
+    "                       them (faster; closed inputs get this anyway)",
+    [](std::vector<string>::iterator &,
+        const std::vector<string>::iterator &) {
+        bool_options.solidInputs = true;
+    });
+
+    cmds.regCmd("threads",
+    "-threads n             Solve the separate parts of each following\n"
+    "                       Boolean command on up to n threads\n"
+    "                       (0 = one per core, the default)",
+    [](std::vector<string>::iterator &args,
+        const std::vector<string>::iterator &end) {
+        if(args == end) { cerr << "too few args for threads" << endl; exit(1); }
+        bool_options.threads = uint(std::max(0, atoi((*args).c_str())));
+        args++;
+    });
 
     // END SHAPESHIFTER
 
     cmds.regCmd("union",
     "-union in0 in1 out     Compute the Boolean union of in0 and in1,\n"
     "                       and output the result",
-    genericBinaryOp(computeUnion));
+    genericBoolOp(computeUnion));
     cmds.regCmd("diff",
     "-diff in0 in1 out      Compute the Boolean difference of in0 and in1,\n"
     "                       and output the result",
-    genericBinaryOp(computeDifference));
+    genericBoolOp(computeDifference));
     cmds.regCmd("isct",
     "-isct in0 in1 out      Compute the Boolean intersection of in0 and in1,\n"
     "                       and output the result",
-    genericBinaryOp(computeIntersection));
+    genericBoolOp(computeIntersection));
     cmds.regCmd("xor",
     "-xor in0 in1 out       Compute the Boolean XOR of in0 and in1,\n"
     "                       and output the result\n"
     "                       (aka. the symmetric difference)",
-    genericBinaryOp(computeSymmetricDifference));
+    genericBoolOp(computeSymmetricDifference));
     cmds.regCmd("resolve",
     "-resolve in0 in1 out   Intersect the two meshes in0 and in1,\n"
     "                       and output the connected mesh with those\n"
     "                       intersections made explicit and connected",
     genericBinaryOp(resolveIntersections));
     
+    // SHAPESHIFTER
+    cmds.regCmd("booleans",
+    "-booleans in0 in1 union diff isct xor\n"
+    "                       Compute any of the four Boolean results of\n"
+    "                       in0 and in1 while only intersecting them once;\n"
+    "                       give - instead of a filename to skip a result",
+    [](std::vector<string>::iterator &args,
+        const std::vector<string>::iterator &end) {
+        CorkTriMesh in0;
+        CorkTriMesh in1;
+        
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        loadMesh(*args, &in0);
+        args++;
+        
+        if(args == end) { cerr << "too few args" << endl; exit(1); }
+        loadMesh(*args, &in1);
+        args++;
+        
+        string filenames[4];
+        CorkTriMesh outs[4];
+        for(uint k=0; k<4; k++) {
+            if(args == end) { cerr << "too few args" << endl; exit(1); }
+            filenames[k] = *args;
+            args++;
+        }
+        
+        computeAllBooleans(in0, in1,
+            (filenames[0] != "-")?  &outs[0] : NULL,
+            (filenames[1] != "-")?  &outs[1] : NULL,
+            (filenames[2] != "-")?  &outs[2] : NULL,
+            (filenames[3] != "-")?  &outs[3] : NULL,
+            &bool_options);
+        if(report_slivers)
+            cout << "removed " << bool_options.slivers_removed
+                 << " sliver triangles" << endl;
+        
+        for(uint k=0; k<4; k++) {
+            if(filenames[k] == "-")     continue;
+            saveMesh(filenames[k], outs[k]);
+            freeCorkTriMesh(&outs[k]);
+        }
+        
+        delete[] in0.vertices;
+        delete[] in0.triangles;
+        delete[] in1.vertices;
+        delete[] in1.triangles;
+    });
+    cmds.regCmd("unionN",
+    "-unionN out in0 in1 ...\n"
+    "                       Compute the Boolean union of all of the inputs\n"
+    "                       in one pass, and output the result",
+    genericNaryOp(computeUnionN));
+    cmds.regCmd("isctN",
+    "-isctN out in0 in1 ... Compute the Boolean intersection of all of the\n"
+    "                       inputs in one pass, and output the result",
+    genericNaryOp(computeIntersectionN));
+    // END SHAPESHIFTER
+    
     
     cmds.runCommands(arg_it, args.end());
     
-    return 0;
+    return exit_status;
 }
 
 
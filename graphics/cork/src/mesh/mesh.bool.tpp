@@ -25,6 +25,8 @@
 // +-------------------------------------------------------------------------
 #pragma once
 
+#include "parallel.h"
+
 #include <queue>
 
 template<class VertData, class TriData>
@@ -38,11 +40,39 @@ public:
     // do things
     void doSetup(Mesh &rhs);
     
-    // choose what to remove
+    // choose what to remove, then clean up the result;
+    // returns the number of sliver triangles cleaned up
     enum TriCode { KEEP_TRI, DELETE_TRI, FLIP_TRI };
-    void doDeleteAndFlip(
+    uint doDeleteAndFlip(
         std::function<TriCode(byte bool_alg_data)> classify
     );
+    
+    // what each operation keeps, going by the labels doSetup() leaves:
+    // bit 1 is the operand, bit 2 is set if inside the other operand
+    static TriCode classifyUnion(byte data);
+    static TriCode classifyDiff(byte data);
+    static TriCode classifyIsct(byte data);
+    static TriCode classifyXor(byte data);
+    static TriCode classify(BoolOp op, byte data);
+    
+    // N-ary union/intersection of mesh and all of rhs.  Each pass labels
+    // up to MAX_NARY_OPERANDS operands by index, resolves all of their
+    // intersections at once, and keeps the surface patches inside none
+    // (union) or all (intersection) of the other operands
+    static const uint MAX_NARY_OPERANDS = 256;
+    uint doNary(std::vector<Mesh*> &rhs, bool intersect);
+    
+    // TESTING
+    uint testingEdgeCache()
+    {
+        populateECache();
+        uint count = 0;
+        for_ecache([&](uint, uint, bool isisct,
+                       const ShortVec<uint, 2> &) {
+            if(isisct)  count++;
+        });
+        return count;
+    }
 
 private: // methods
     struct BoolEdata {
@@ -53,6 +83,20 @@ private: // methods
         return mesh->tris[tri_id].data.bool_alg_data;
     }
     
+    // How the operands' surfaces can relate.  If they cannot cross,
+    // there is nothing for resolveIntersections() to do, and every
+    // component of each operand lies wholly inside or outside the other
+    enum OperandOverlap {
+        BOXES_DISJOINT,     // the operands' bounding boxes don't touch
+        SURFACES_DISJOINT,  // no two triangle boxes of different operands
+                            // touch; containment is still possible
+        SURFACES_MAY_CROSS
+    };
+    // on SURFACES_MAY_CROSS, region is set to the overlap of the
+    // operand boxes, outside of which nothing can cross (give or take
+    // the padding the intersection search adds to it)
+    OperandOverlap classifyOverlap(BBox3d *region);
+    
     void populateECache()
     {
         ecache = mesh->createEGraphCache<BoolEdata>();
@@ -70,11 +114,9 @@ private: // methods
         });
     }
     
-    inline void for_ecache(
-        std::function<void(uint i, uint j,
-                           bool isisct,
-                           const ShortVec<uint, 2> &tids)> action
-    ) {
+    // action(uint i, uint j, bool isisct, const ShortVec<uint, 2> &tids)
+    template<class Func>
+    inline void for_ecache(Func action) {
         ecache.for_each([&](uint i, uint j, EGraphEntry<BoolEdata> &entry) {
             if(entry.data.is_isct) {
                 ShortVec<uint, 2> tid0s;
@@ -97,13 +139,44 @@ private: // methods
     {
     }
     
-    bool isInside(uint tid, byte operand) {
-        // find the point to trace outward from...
+    inline Vec3d centroid(uint tid) const {
         Vec3d p(0,0,0);
         p += mesh->verts[mesh->tris[tid].a].pos;
         p += mesh->verts[mesh->tris[tid].b].pos;
         p += mesh->verts[mesh->tris[tid].c].pos;
-        p /= 3.0;
+        return p / 3.0;
+    }
+    
+    // +1/-1 if the ray crosses tri going out/in, 0 if it misses
+    int rayWinding(const Ray3d &r, const Tri &tri) const {
+        double flip = 1.0;
+        uint   a = tri.a;
+        uint   b = tri.b;
+        uint   c = tri.c;
+        Vec3d va = mesh->verts[a].pos;
+        Vec3d vb = mesh->verts[b].pos;
+        Vec3d vc = mesh->verts[c].pos;
+        // normalize vertex order (to prevent leaks)
+        if(a > b) { std::swap(a, b); std::swap(va, vb); flip = -flip; }
+        if(b > c) { std::swap(b, c); std::swap(vb, vc); flip = -flip; }
+        if(a > b) { std::swap(a, b); std::swap(va, vb); flip = -flip; }
+        
+        double t;
+        Vec3d bary;
+        if(isct_ray_triangle(r, va, vb, vc, &t, &bary)) {
+            Vec3d normal = flip * cross(vb - va, vc - va);
+            if(dot(normal, r.r) > 0.0) { // UNSAFE
+                return 1;
+            } else {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    
+    bool isInside(uint tid, byte operand) {
+        // find the point to trace outward from...
+        Vec3d p = centroid(tid);
         // ok, we've got the point, now let's pick a direction
         Ray3d r;
         r.p = p;
@@ -116,34 +189,43 @@ private: // methods
             // ignore triangles from the same operand surface
             if((tri.data.bool_alg_data & 1) == operand)   continue;
             
-            double flip = 1.0;
-            uint   a = tri.a;
-            uint   b = tri.b;
-            uint   c = tri.c;
-            Vec3d va = mesh->verts[a].pos;
-            Vec3d vb = mesh->verts[b].pos;
-            Vec3d vc = mesh->verts[c].pos;
-            // normalize vertex order (to prevent leaks)
-            if(a > b) { std::swap(a, b); std::swap(va, vb); flip = -flip; }
-            if(b > c) { std::swap(b, c); std::swap(vb, vc); flip = -flip; }
-            if(a > b) { std::swap(a, b); std::swap(va, vb); flip = -flip; }
-            
-            double t;
-            Vec3d bary;
-            if(isct_ray_triangle(r, va, vb, vc, &t, &bary)) {
-                Vec3d normal = flip * cross(vb - va, vc - va);
-                if(dot(normal, r.r) > 0.0) { // UNSAFE
-                    winding++;
-                } else {
-                    winding--;
-                }
-            }
+            winding += rayWinding(r, tri);
         }
         
         // now, we've got a winding number to work with...
         return winding > 0;
     }
     
+    // how many operands, other than its own, contain triangle tid?
+    // tri_bvh indexes every triangle, and bounds is the mesh's box
+    uint insideCount(
+        uint tid, uint noperands,
+        AABVH<uint> &tri_bvh, const BBox3d &bounds
+    ) {
+        // the ray leans along +x, so that only the triangles in a thin
+        // slab running from the point to the far side need testing
+        Ray3d r;
+        r.p = centroid(tid);
+        r.r = Vec3d(1.0, drand(-0.2,0.2), drand(-0.2,0.2));
+        Vec3d end = r.p + std::max(0.0, bounds.maxp.x - r.p.x) * r.r;
+        BBox3d slab(min(r.p, end), max(r.p, end));
+        
+        std::vector<int> windings(noperands, 0);
+        byte operand = boolData(tid);
+        tri_bvh.for_each_in_box(slab, [&](uint other) {
+            byte other_operand = boolData(other);
+            if(other_operand == operand)    return;
+            windings[other_operand] += rayWinding(r, mesh->tris[other]);
+        });
+        
+        uint count = 0;
+        for(int winding : windings)
+            if(winding > 0)     count++;
+        return count;
+    }
+    
+    uint doNaryPass(Mesh **rhs, uint nrhs, bool intersect);
+    
 private: // data
     Mesh                        *mesh;
     EGraphCache<BoolEdata>      ecache;
@@ -157,6 +239,66 @@ static inline double triArea(
 }
 
 
+template<class VertData, class TriData>
+typename Mesh<VertData,TriData>::BoolProblem::OperandOverlap
+Mesh<VertData,TriData>::BoolProblem::classifyOverlap(BBox3d *region)
+{
+    // O(n) pass to find triangle and operand bounding boxes
+    std::vector<BBox3d> tri_boxes(mesh->tris.size());
+    BBox3d op_boxes[2];
+    for(uint tid=0; tid<mesh->tris.size(); tid++) {
+        const Tri &tri = mesh->tris[tid];
+        Vec3d p0 = mesh->verts[tri.a].pos;
+        Vec3d p1 = mesh->verts[tri.b].pos;
+        Vec3d p2 = mesh->verts[tri.c].pos;
+        tri_boxes[tid] = BBox3d(min(p0, min(p1, p2)), max(p0, max(p1, p2)));
+        BBox3d &op_box = op_boxes[boolData(tid) & 1];
+        op_box = convex(op_box, tri_boxes[tid]);
+    }
+    if(isEmpty(op_boxes[0]) || isEmpty(op_boxes[1]) ||
+       !hasIsct(op_boxes[0], op_boxes[1]))
+        return BOXES_DISJOINT;
+    
+    // pad the boxes as the intersection search does its region, so
+    // that nothing it could find crossing is taken to be apart
+    double pad = IsctProblem::searchPadding(
+                    convex(op_boxes[0], op_boxes[1]));
+    Vec3d padv(pad, pad, pad);
+    BBox3d overlap = isct(op_boxes[0], op_boxes[1]);
+    BBox3d padded = BBox3d(overlap.minp - padv, overlap.maxp + padv);
+    
+    // only triangles near the overlap of the operand boxes matter;
+    // put operand 1's in a BVH and look for any operand 0 box touching one
+    std::vector< GeomBlob<uint> > blobs;
+    for(uint tid=0; tid<mesh->tris.size(); tid++) {
+        if((boolData(tid) & 1) != 1)                continue;
+        if(!hasIsct(tri_boxes[tid], padded))        continue;
+        GeomBlob<uint> blob;
+        blob.bbox   = BBox3d(tri_boxes[tid].minp - padv,
+                             tri_boxes[tid].maxp + padv);
+        blob.point  = (blob.bbox.minp + blob.bbox.maxp) / 2.0;
+        blob.id     = tid;
+        blobs.push_back(blob);
+    }
+    if(blobs.empty())
+        return SURFACES_DISJOINT;
+    AABVH<uint> bvh(blobs);
+    
+    bool touching = false;
+    for(uint tid=0; tid<mesh->tris.size() && !touching; tid++) {
+        if((boolData(tid) & 1) != 0)                continue;
+        if(!hasIsct(tri_boxes[tid], padded))        continue;
+        bvh.for_each_in_box(tri_boxes[tid], [&](uint) {
+            touching = true;
+        });
+    }
+    if(!touching)
+        return SURFACES_DISJOINT;
+    *region = overlap;
+    return SURFACES_MAY_CROSS;
+}
+
+
 template<class VertData, class TriData>
 void Mesh<VertData,TriData>::BoolProblem::doSetup(
     Mesh &rhs
@@ -169,8 +311,37 @@ void Mesh<VertData,TriData>::BoolProblem::doSetup(
         tri.bool_alg_data = 1;
     });
     
+    // closed operands are taken to be solid, as they would be if
+    // they crossed nothing of their own (see BoolOptions::solidInputs)
+    bool solid = mesh->bool_options.solidInputs ||
+                 (!mesh->bool_options.validateInputs &&
+                  mesh->isClosed() && rhs.isClosed());
+    
     mesh->disjointUnion(rhs);
-    mesh->resolveIntersections();
+    
+    // intersections between the operands can only occur where they
+    // overlap.  For solid inputs that is all there is to find, so
+    // the rest of the mesh is left out of the search entirely, and
+    // only crossings between operands are searched for
+    OperandOverlap overlap;
+    if(mesh->bool_options.validateInputs) {
+        overlap = SURFACES_MAY_CROSS;
+        mesh->resolveIntersections();
+    } else {
+        BBox3d region;
+        overlap = classifyOverlap(&region);
+        if(overlap == SURFACES_MAY_CROSS && !solid) {
+            mesh->resolveIntersections();
+        } else if(overlap == SURFACES_MAY_CROSS) {
+            std::vector<byte> operands(mesh->tris.size());
+            for(uint tid=0; tid<mesh->tris.size(); tid++)
+                operands[tid] = boolData(tid) & 1;
+            IsctSearch search;
+            search.region   = &region;
+            search.operands = &operands;
+            mesh->resolveIntersections(search);
+        }
+    }
     
     populateECache();
     
@@ -225,7 +396,8 @@ void Mesh<VertData,TriData>::BoolProblem::doSetup(
         }
         
         byte operand = boolData(best_tid);
-        bool inside = isInside(best_tid, operand);
+        bool inside = (overlap == BOXES_DISJOINT)?
+                            false : isInside(best_tid, operand);
         
         // NOW PROPAGATE classification throughout the component.
         // do a breadth first propagation
@@ -261,7 +433,7 @@ void Mesh<VertData,TriData>::BoolProblem::doSetup(
 
 
 template<class VertData, class TriData>
-void Mesh<VertData,TriData>::BoolProblem::doDeleteAndFlip(
+uint Mesh<VertData,TriData>::BoolProblem::doDeleteAndFlip(
     std::function<TriCode(byte bool_alg_data)> classify
 ) {
     TopoCache topocache(mesh);
@@ -287,6 +459,11 @@ void Mesh<VertData,TriData>::BoolProblem::doDeleteAndFlip(
     }
     
     topocache.commit();
+    
+    // subdividing along the intersection curve leaves slivers behind
+    if(!mesh->bool_options.cleanSlivers)
+        return 0;
+    return mesh->cleanSlivers(mesh->bool_options.sliverAngle);
 }
 
 
@@ -294,66 +471,467 @@ void Mesh<VertData,TriData>::BoolProblem::doDeleteAndFlip(
 
 
 template<class VertData, class TriData>
-void Mesh<VertData,TriData>::boolUnion(Mesh &rhs)
-{
-    BoolProblem bprob(this);
+uint Mesh<VertData,TriData>::BoolProblem::doNary(
+    std::vector<Mesh*> &rhs, bool intersect
+) {
+    // operand labels are bytes, so very many operands take several
+    // passes, each folding in the next batch
+    uint slivers = 0;
+    for(uint first=0; first<rhs.size(); first += MAX_NARY_OPERANDS-1) {
+        uint nrhs = std::min<uint>(rhs.size() - first, MAX_NARY_OPERANDS-1);
+        slivers += doNaryPass(&rhs[first], nrhs, intersect);
+    }
+    return slivers;
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::BoolProblem::doNaryPass(
+    Mesh **rhs, uint nrhs, bool intersect
+) {
+    uint noperands = nrhs + 1;
     
-    bprob.doSetup(rhs);
+    // closed operands are taken to be solid, as in doSetup()
+    bool solid = mesh->bool_options.solidInputs;
+    if(!solid && !mesh->bool_options.validateInputs) {
+        solid = mesh->isClosed();
+        for(uint k=0; k<nrhs && solid; k++)
+            solid = rhs[k]->isClosed();
+    }
     
-    bprob.doDeleteAndFlip([](byte data) -> typename BoolProblem::TriCode {
-        if((data & 2) == 2)     // part of op 0/1 INSIDE op 1/0
-            return BoolProblem::DELETE_TRI;
-        else                    // part of op 0/1 OUTSIDE op 1/0
-            return BoolProblem::KEEP_TRI;
+    // Label surfaces by operand index
+    mesh->for_tris([](TriData &tri, VertData&, VertData&, VertData&) {
+        tri.bool_alg_data = 0;
     });
+    for(uint k=0; k<nrhs; k++) {
+        byte label = byte(k+1);
+        rhs[k]->for_tris([label](TriData &tri,
+                                 VertData&, VertData&, VertData&) {
+            tri.bool_alg_data = label;
+        });
+        mesh->disjointUnion(*rhs[k]);
+    }
+    
+    // crossings can only occur where some pair of operand boxes overlap
+    std::vector<BBox3d> op_boxes(noperands);
+    BBox3d bounds;
+    for(uint tid=0; tid<mesh->tris.size(); tid++) {
+        const Tri &tri = mesh->tris[tid];
+        Vec3d p0 = mesh->verts[tri.a].pos;
+        Vec3d p1 = mesh->verts[tri.b].pos;
+        Vec3d p2 = mesh->verts[tri.c].pos;
+        BBox3d box(min(p0, min(p1, p2)), max(p0, max(p1, p2)));
+        op_boxes[boolData(tid)] = convex(op_boxes[boolData(tid)], box);
+        bounds = convex(bounds, box);
+    }
+    if(isEmpty(bounds))
+        return 0;
+    BBox3d region;
+    for(uint i=0; i<noperands; i++) {
+        for(uint j=i+1; j<noperands; j++) {
+            BBox3d overlap = isct(op_boxes[i], op_boxes[j]);
+            if(!isEmpty(overlap))
+                region = convex(region, overlap);
+        }
+    }
+    
+    if(mesh->bool_options.validateInputs ||
+       (!solid && !isEmpty(region))) {
+        mesh->resolveIntersections();
+    } else if(!isEmpty(region)) {
+        std::vector<byte> operands(mesh->tris.size());
+        for(uint tid=0; tid<mesh->tris.size(); tid++)
+            operands[tid] = boolData(tid);
+        IsctSearch search;
+        search.region   = &region;
+        search.operands = &operands;
+        mesh->resolveIntersections(search);
+    }
+    
+    populateECache();
+    
+    // Cut each operand's surface into patches along the intersection
+    // curves.  Each patch lies wholly inside or outside of every
+    // other operand, so it needs just one inside/outside test
+    uint ntris = mesh->tris.size();
+    UnionFind uf(ntris);
+    ecache.for_each([&](uint, uint, EGraphEntry<BoolEdata> &entry) {
+        if(entry.data.is_isct)  return;
+        for(uint k=1; k<entry.tids.size(); k++)
+            uf.unionIds(entry.tids[0], entry.tids[k]);
+    });
+    
+    // test from the largest triangle in each patch
+    std::vector<uint> best_tid(ntris, uint(-1));
+    std::vector<double> best_area(ntris, -1.0);
+    for(uint tid=0; tid<ntris; tid++) {
+        uint patch = uf.find(tid);
+        Vec3d va = mesh->verts[mesh->tris[tid].a].pos;
+        Vec3d vb = mesh->verts[mesh->tris[tid].b].pos;
+        Vec3d vc = mesh->verts[mesh->tris[tid].c].pos;
+        double area = triArea(va, vb, vc);
+        if(area > best_area[patch]) {
+            best_area[patch] = area;
+            best_tid[patch] = tid;
+        }
+    }
+    
+    std::vector< GeomBlob<uint> > tri_geoms(ntris);
+    for(uint tid=0; tid<ntris; tid++) {
+        Vec3d p0 = mesh->verts[mesh->tris[tid].a].pos;
+        Vec3d p1 = mesh->verts[mesh->tris[tid].b].pos;
+        Vec3d p2 = mesh->verts[mesh->tris[tid].c].pos;
+        tri_geoms[tid].bbox  = BBox3d(min(p0, min(p1, p2)),
+                                      max(p0, max(p1, p2)));
+        tri_geoms[tid].point = (p0 + p1 + p2) / 3.0;
+        tri_geoms[tid].id    = tid;
+    }
+    AABVH<uint> tri_bvh(tri_geoms);
+    
+    // a union keeps what is inside no other operand;
+    // an intersection keeps what is inside all of them
+    uint keep_count = (intersect)? noperands - 1 : 0;
+    std::vector<bool> keep_patch(ntris, false);
+    for(uint patch=0; patch<ntris; patch++) {
+        if(best_tid[patch] == uint(-1))     continue;
+        keep_patch[patch] = (insideCount(best_tid[patch], noperands,
+                                         tri_bvh, bounds) == keep_count);
+    }
+    
+    // relabel for doDeleteAndFlip(): 0 to keep, 1 to delete
+    for(uint tid=0; tid<ntris; tid++)
+        boolData(tid) = (keep_patch[uf.find(tid)])? 0 : 1;
+    
+    return doDeleteAndFlip([](byte data) -> TriCode {
+        return (data)? DELETE_TRI : KEEP_TRI;
+    });
+}
+
+
+template<class VertData, class TriData>
+typename Mesh<VertData,TriData>::BoolProblem::TriCode
+Mesh<VertData,TriData>::BoolProblem::classifyUnion(byte data)
+{
+    if((data & 2) == 2)     // part of op 0/1 INSIDE op 1/0
+        return DELETE_TRI;
+    else                    // part of op 0/1 OUTSIDE op 1/0
+        return KEEP_TRI;
+}
+
+template<class VertData, class TriData>
+typename Mesh<VertData,TriData>::BoolProblem::TriCode
+Mesh<VertData,TriData>::BoolProblem::classifyDiff(byte data)
+{
+    if(data == 2 ||         // part of op 0 INSIDE op 1
+       data == 1)           // part of op 1 OUTSIDE op 0
+        return DELETE_TRI;
+    else if(data == 3)      // part of op 1 INSIDE op 1
+        return FLIP_TRI;
+    else                    // part of op 0 OUTSIDE op 1
+        return KEEP_TRI;
+}
+
+template<class VertData, class TriData>
+typename Mesh<VertData,TriData>::BoolProblem::TriCode
+Mesh<VertData,TriData>::BoolProblem::classifyIsct(byte data)
+{
+    if((data & 2) == 0)     // part of op 0/1 OUTSIDE op 1/0
+        return DELETE_TRI;
+    else                    // part of op 0/1 INSIDE op 1/0
+        return KEEP_TRI;
 }
 
 template<class VertData, class TriData>
-void Mesh<VertData,TriData>::boolDiff(Mesh &rhs)
+typename Mesh<VertData,TriData>::BoolProblem::TriCode
+Mesh<VertData,TriData>::BoolProblem::classifyXor(byte data)
 {
+    if((data & 2) == 0)     // part of op 0/1 OUTSIDE op 1/0
+        return KEEP_TRI;
+    else                    // part of op 0/1 INSIDE op 1/0
+        return FLIP_TRI;
+}
+
+
+
+template<class VertData, class TriData>
+typename Mesh<VertData,TriData>::BoolProblem::TriCode
+Mesh<VertData,TriData>::BoolProblem::classify(BoolOp op, byte data)
+{
+    switch(op) {
+    case BOOL_UNION:    return classifyUnion(data);
+    case BOOL_DIFF:     return classifyDiff(data);
+    case BOOL_ISCT:     return classifyIsct(data);
+    case BOOL_XOR:
+    default:            return classifyXor(data);
+    }
+}
+
+
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolDirect(Mesh &rhs, BoolOp op)
+{
+    uint slivers;
+    if(boolConvex(rhs, op, &slivers))
+        return slivers;
+    
     BoolProblem bprob(this);
     
     bprob.doSetup(rhs);
     
-    bprob.doDeleteAndFlip([](byte data) -> typename BoolProblem::TriCode {
-        if(data == 2 ||         // part of op 0 INSIDE op 1
-           data == 1)           // part of op 1 OUTSIDE op 0
-            return BoolProblem::DELETE_TRI;
-        else if(data == 3)      // part of op 1 INSIDE op 1
-            return BoolProblem::FLIP_TRI;
-        else                    // part of op 0 OUTSIDE op 1
-            return BoolProblem::KEEP_TRI;
+    return bprob.doDeleteAndFlip([op](byte data) {
+        return BoolProblem::classify(op, data);
     });
 }
 
 template<class VertData, class TriData>
-void Mesh<VertData,TriData>::boolIsct(Mesh &rhs)
+uint Mesh<VertData,TriData>::boolDirectAll(Mesh &rhs, Mesh *outs[4])
 {
-    BoolProblem bprob(this);
+    // a single result in place of this is just that operation
+    uint nouts = 0;
+    uint only = 0;
+    for(uint k=0; k<4; k++) {
+        if(outs[k]) { nouts++; only = k; }
+    }
+    if(nouts == 1 && outs[only] == this)
+        return boolDirect(rhs, BoolOp(only));
     
-    bprob.doSetup(rhs);
+    // the convex kernel clips out each result it applies to on its own;
+    // the rest are filtered from one shared resolution.  The results
+    // are only handed out at the end, as one of them may be this
+    Mesh results[4];
+    bool filter[4] = { false, false, false, false };
+    bool any_filter = false;
+    bool convex = bool_options.convexKernel && !bool_options.validateInputs &&
+                  isConvex() && rhs.isConvex();
+    uint slivers = 0;
+    for(uint k=0; k<4; k++) {
+        if(!outs[k])    continue;
+        if(convex && (k == BOOL_ISCT || k == BOOL_DIFF)) {
+            uint convex_slivers;
+            results[k].disjointUnion(*this);
+            results[k].bool_options = bool_options;
+            if(results[k].boolConvex(rhs, BoolOp(k), &convex_slivers)) {
+                slivers += convex_slivers;
+                continue;
+            }
+            results[k] = Mesh();
+        }
+        filter[k] = any_filter = true;
+    }
+    
+    if(any_filter) {
+        Mesh arrangement;
+        arrangement.disjointUnion(*this);
+        arrangement.bool_options = bool_options;
+        BoolProblem bprob(&arrangement);
+        bprob.doSetup(rhs);
+        
+        // every result is the same labeled arrangement with a different
+        // filter applied, so each just gets a copy to filter
+        for(uint k=0; k<4; k++) {
+            if(!filter[k])  continue;
+            results[k].disjointUnion(arrangement);
+            results[k].bool_options = bool_options;
+            BoolProblem out_prob(&results[k]);
+            BoolOp op = BoolOp(k);
+            slivers += out_prob.doDeleteAndFlip([op](byte data) {
+                return BoolProblem::classify(op, data);
+            });
+        }
+    }
+    
+    for(uint k=0; k<4; k++) {
+        if(outs[k])     *outs[k] = std::move(results[k]);
+    }
+    return slivers;
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolByComponents(Mesh &rhs, BoolOp op)
+{
+    Mesh *outs[4] = { nullptr, nullptr, nullptr, nullptr };
+    outs[op] = this;
+    return boolByComponents(rhs, outs);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolByComponents(Mesh &rhs, Mesh *outs[4])
+{
+    // searching for self-intersections needs the operands whole
+    if(!bool_options.byComponents || bool_options.validateInputs)
+        return boolDirectAll(rhs, outs);
+    
+    std::vector<Mesh> parts[2];
+    splitIntoComponents(parts[0]);
+    rhs.splitIntoComponents(parts[1]);
+    if(parts[0].size() <= 1 && parts[1].size() <= 1)
+        return boolDirectAll(rhs, outs);
+    // A component only bounds a region of its own if it is closed.  The
+    // open pieces of a surface (the sphere primitive is stitched from
+    // several) enclose something only together, and cannot be split up
+    for(uint i=0; i<2; i++)
+        for(Mesh &part : parts[i])
+            if(!part.isClosed())
+                return boolDirectAll(rhs, outs);
+    
+    // Components interact only if their boxes overlap.  Group them by
+    // linking every component to the other operand's components which
+    // its box touches.  A surface is only ever classified against the
+    // other operand, and every component of that which could contain
+    // any of it is in its group, so the groups can be solved apart
+    uint n0 = parts[0].size();
+    uint n1 = parts[1].size();
+    std::vector<BBox3d> boxes(n0 + n1);
+    for(uint k=0; k<n0+n1; k++) {
+        Mesh &part = (k < n0)? parts[0][k] : parts[1][k-n0];
+        for(const VertData &v : part.verts)
+            boxes[k] = convex(boxes[k], BBox3d(v.pos, v.pos));
+    }
+    
+    UnionFind uf(n0 + n1);
+    std::vector<bool> grouped(n0 + n1, false);
+    std::vector< GeomBlob<uint> > blobs;
+    for(uint k=n0; k<n0+n1; k++) {
+        if(parts[1][k-n0].tris.empty())     continue;
+        GeomBlob<uint> blob;
+        blob.bbox   = boxes[k];
+        blob.point  = (boxes[k].minp + boxes[k].maxp) / 2.0;
+        blob.id     = k;
+        blobs.push_back(blob);
+    }
+    if(!blobs.empty()) {
+        AABVH<uint> bvh(blobs);
+        for(uint k=0; k<n0; k++) {
+            if(parts[0][k].tris.empty())    continue;
+            bvh.for_each_in_box(boxes[k], [&](uint other) {
+                uf.unionIds(k, other);
+                grouped[k] = grouped[other] = true;
+            });
+        }
+    }
+    
+    // gather each group's components back into a pair of operands
+    std::vector<uint> group_of(n0 + n1, uint(-1));
+    std::vector<Mesh> group_ops[2];
+    for(uint k=0; k<n0+n1; k++) {
+        if(!grouped[k])     continue;
+        uint &group = group_of[uf.find(k)];
+        if(group == uint(-1)) {
+            group = group_ops[0].size();
+            group_ops[0].push_back(Mesh());
+            group_ops[1].push_back(Mesh());
+        }
+        if(k < n0)  group_ops[0][group].disjointUnion(parts[0][k]);
+        else        group_ops[1][group].disjointUnion(parts[1][k-n0]);
+    }
     
-    bprob.doDeleteAndFlip([](byte data) -> typename BoolProblem::TriCode {
-        if((data & 2) == 0)     // part of op 0/1 OUTSIDE op 1/0
-            return BoolProblem::DELETE_TRI;
-        else                    // part of op 0/1 INSIDE op 1/0
-            return BoolProblem::KEEP_TRI;
+    // a lone result in place of this is worked out in place of each
+    // group's left operand, as it is then not needed for anything else
+    uint ngroups = group_ops[0].size();
+    uint nouts = 0;
+    uint only = 0;
+    for(uint k=0; k<4; k++) {
+        if(outs[k]) { nouts++; only = k; }
+    }
+    bool in_place = (nouts == 1 && outs[only] == this);
+    std::vector<Mesh> group_outs[4];
+    for(uint k=0; k<4; k++) {
+        if(outs[k] && !in_place)
+            group_outs[k].resize(ngroups);
+    }
+    std::vector<uint> slivers(ngroups, 0);
+    parallel_for(ngroups, bool_options.threads, [&](uint g) {
+        Mesh *outs_g[4] = { nullptr, nullptr, nullptr, nullptr };
+        for(uint k=0; k<4; k++) {
+            if(!outs[k])    continue;
+            outs_g[k] = (in_place)? &group_ops[0][g] : &group_outs[k][g];
+        }
+        group_ops[0][g].bool_options = bool_options;
+        slivers[g] = group_ops[0][g].boolDirectAll(group_ops[1][g], outs_g);
     });
+    if(in_place)
+        group_outs[only].swap(group_ops[0]);
+    
+    // An ungrouped component is outside the other operand entirely,
+    // so it is kept as is or dropped, just like any outside surface
+    uint total_slivers = 0;
+    for(uint g=0; g<ngroups; g++)
+        total_slivers += slivers[g];
+    Mesh results[4];
+    for(uint k=0; k<4; k++) {
+        if(!outs[k])    continue;
+        for(uint g=0; g<ngroups; g++)
+            results[k].disjointUnion(group_outs[k][g]);
+        for(uint i=0; i<n0+n1; i++) {
+            if(grouped[i])      continue;
+            byte operand = (i < n0)? 0 : 1;
+            if(BoolProblem::classify(BoolOp(k), operand) !=
+               BoolProblem::KEEP_TRI)
+                continue;
+            results[k].disjointUnion((i < n0)? parts[0][i] : parts[1][i-n0]);
+        }
+    }
+    for(uint k=0; k<4; k++) {
+        if(outs[k])     *outs[k] = std::move(results[k]);
+    }
+    return total_slivers;
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolUnion(Mesh &rhs)
+{
+    return boolByComponents(rhs, BOOL_UNION);
 }
 
 template<class VertData, class TriData>
-void Mesh<VertData,TriData>::boolXor(Mesh &rhs)
+uint Mesh<VertData,TriData>::boolDiff(Mesh &rhs)
+{
+    return boolByComponents(rhs, BOOL_DIFF);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolIsct(Mesh &rhs)
+{
+    return boolByComponents(rhs, BOOL_ISCT);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolXor(Mesh &rhs)
+{
+    return boolByComponents(rhs, BOOL_XOR);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolUnionN(std::vector<Mesh*> &rhs)
 {
     BoolProblem bprob(this);
     
-    bprob.doSetup(rhs);
+    return bprob.doNary(rhs, false);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolIsctN(std::vector<Mesh*> &rhs)
+{
+    BoolProblem bprob(this);
     
-    bprob.doDeleteAndFlip([](byte data) -> typename BoolProblem::TriCode {
-        if((data & 2) == 0)     // part of op 0/1 OUTSIDE op 1/0
-            return BoolProblem::KEEP_TRI;
-        else                    // part of op 0/1 INSIDE op 1/0
-            return BoolProblem::FLIP_TRI;
-    });
+    return bprob.doNary(rhs, true);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::boolAll(
+    Mesh &rhs,
+    Mesh *union_out, Mesh *diff_out, Mesh *isct_out, Mesh *xor_out
+) {
+    // (in the order of BoolOp)
+    Mesh *outs[4] = { union_out, diff_out, isct_out, xor_out };
+    return boolByComponents(rhs, outs);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::testingBoolEdgeCache()
+{
+    BoolProblem bprob(this);
+    return bprob.testingEdgeCache();
 }
 
 
@@ -0,0 +1,563 @@
+// +-------------------------------------------------------------------------
+// | mesh.convex.tpp
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include "empty3d.h"
+#include "quantization.h"
+
+#include <unordered_map>
+
+// Booleans between two convex solids, by clipping one against the
+// face planes of the other.  Which side of a plane each vertex is on
+// is decided once, and the connectivity of the clipped surface follows
+// from those decisions alone, so the result is closed whatever the
+// rounding of the new vertices.
+
+
+// directed edge a->b as a single key
+inline uint64_t convexEdgeKey(uint a, uint b) {
+    return (uint64_t(a) << 32) | uint64_t(b);
+}
+// undirected edge {a,b} as a single key
+inline uint64_t convexSegKey(uint a, uint b) {
+    return (a < b)? convexEdgeKey(a, b) : convexEdgeKey(b, a);
+}
+
+// Faces meant to be flat are often stored with rounded coordinates,
+// e.g. those of a rotated cube.  Points within this distance (relative
+// to the largest coordinate) of a plane count as lying on it
+const double CONVEX_FLATNESS = 1e-5;
+// Each plane is clipped against the whole remaining surface, and leaves
+// a trail of cut faces.  Past this many planes the general method wins
+const uint CONVEX_MAX_PLANES = 64;
+
+// the plane through a triangle
+struct ConvexPlane
+{
+    Empty3d::TriIn  tri;
+    Vec3d           normal;     // unit length, or zero if degenerate
+    
+    ConvexPlane(const Vec3d &p0, const Vec3d &p1, const Vec3d &p2) {
+        tri.p[0] = p0;
+        tri.p[1] = p1;
+        tri.p[2] = p2;
+        normal = cross(p1 - p0, p2 - p0);
+        double length = len(normal);
+        if(length > 0.0)
+            normal /= length;
+    }
+    
+    inline double distance(const Vec3d &p) const {
+        return dot(normal, p - tri.p[0]);
+    }
+    // +1 in front, -1 behind, 0 within tol of the plane;
+    // decided exactly outside of that band
+    inline int side(const Vec3d &p, double tol) const {
+        if(fabs(distance(p)) <= tol)
+            return 0;
+        return Empty3d::orient(tri, p);
+    }
+};
+
+
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::isConvex()
+{
+    if(convexity == CONVEXITY_UNKNOWN) {
+        double maxMag = 0.0;
+        for(VertData &v : verts)
+            maxMag = std::max(maxMag, max(abs(v.pos)));
+        Quantization::callibrate(maxMag);
+        std::vector<Vec3d> qpos(verts.size());
+        for(uint i=0; i<verts.size(); i++) {
+            for(uint k=0; k<3; k++)
+                qpos[i].v[k] = Quantization::quantize(verts[i].pos.v[k]);
+        }
+        double tol = CONVEX_FLATNESS * maxMag;
+        convexity = (convexFaceGroups(qpos, tol, nullptr))? CONVEX
+                                                           : NOT_CONVEX;
+    }
+    return convexity == CONVEX;
+}
+
+// Checks that the surface is closed, manifold, a topological sphere
+// and bends outwards (or not at all, up to tol) across every edge,
+// which together mean that it bounds a convex solid.  If so, and
+// groups is given, numbers each triangle with its group of coplanar
+// neighbors.
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::convexFaceGroups(
+    const std::vector<Vec3d> &qpos, double tol, std::vector<uint> *groups
+) {
+    uint ntris = tris.size();
+    if(ntris < 4)   return false;
+    
+    std::unordered_map<uint64_t, uint> edge_tri;
+    edge_tri.reserve(3 * ntris);
+    std::vector<bool> used(verts.size(), false);
+    for(uint tid=0; tid<ntris; tid++) {
+        const Tri &tri = tris[tid];
+        for(uint k=0; k<3; k++) {
+            uint a = tri.v[k];
+            uint b = tri.v[(k+1)%3];
+            if(a == b)  return false;
+            if(!edge_tri.insert(std::make_pair(convexEdgeKey(a, b),
+                                               tid)).second)
+                return false;
+            used[a] = true;
+        }
+    }
+    uint nverts = 0;
+    for(bool u : used)  if(u)  nverts++;
+    // V - E + F for a sphere, with E = 3F/2
+    if(int(nverts) - int(3 * ntris / 2) + int(ntris) != 2)
+        return false;
+    
+    UnionFind uf(ntris);
+    bool bends = false;
+    for(uint tid=0; tid<ntris; tid++) {
+        const Tri &tri = tris[tid];
+        ConvexPlane plane(qpos[tri.a], qpos[tri.b], qpos[tri.c]);
+        if(plane.normal == Vec3d(0,0,0))
+            return false;
+        for(uint k=0; k<3; k++) {
+            auto it = edge_tri.find(convexEdgeKey(tri.v[(k+1)%3], tri.v[k]));
+            if(it == edge_tri.end())    return false;
+            const Tri &other = tris[it->second];
+            uint opp = other.a + other.b + other.c
+                     - tri.v[k] - tri.v[(k+1)%3];
+            int side = plane.side(qpos[opp], tol);
+            if(side > 0)        return false;
+            else if(side < 0)   bends = true;
+            else                uf.unionIds(tid, it->second);
+        }
+    }
+    if(!bends)  return false;
+    
+    if(groups) {
+        groups->resize(ntris);
+        for(uint tid=0; tid<ntris; tid++)
+            (*groups)[tid] = uf.find(tid);
+    }
+    return true;
+}
+
+
+template<class VertData, class TriData>
+class Mesh<VertData,TriData>::ConvexProblem
+{
+public:
+    ConvexProblem(Mesh *lhs, Mesh *rhs, BoolOp op) :
+        op(op), plane_count(0)
+    {
+        operands[0] = lhs;
+        operands[1] = rhs;
+    }
+    
+    // lhs = lhs OP rhs, for OP intersection or difference.
+    // returns false, leaving lhs untouched, if the operands turn out
+    // not to be convex at the common quantization, if the clipping
+    // operand has too many faces, or if clipping does not leave a
+    // clean cut
+    bool run();
+    
+private:
+    // faces are kept as convex polygons while clipping, so that each
+    // cut adds only a couple of vertices to them; they are
+    // triangulated once at the end
+    struct Face {
+        std::vector<uint>   v;
+        TriData             data;
+        bool                cap;    // lies on a clipping plane,
+                                    // not on the subject's surface
+    };
+    
+    bool clip(const ConvexPlane &plane, const TriData &cap_data);
+    uint crossing(uint a, uint b);
+    void expandEdge(uint a, uint b, std::vector<uint> &poly);
+    int  fanApex(const std::vector<uint> &poly);
+    void emit(std::vector<Face> &faces);
+    
+    inline uint addVert(const Vec3d &p) {
+        Vec3d q;
+        for(uint k=0; k<3; k++)
+            q.v[k] = Quantization::quantize(p.v[k]);
+        pos.push_back(q);
+        side.push_back(0);
+        dist.push_back(0.0);
+        stamp.push_back(plane_count);
+        return pos.size() - 1;
+    }
+    
+private:
+    Mesh *operands[2];
+    Mesh *subject;      // the operand being clipped
+    BoolOp op;
+    double tol;
+    
+    std::vector<Vec3d>      pos;    // quantized; subject's vertices first
+    std::vector<int>        side;   // w.r.t. the current plane
+    std::vector<double>     dist;   // approximate signed distance
+    std::vector<uint>       stamp;  // plane side/dist were computed for
+    uint                    plane_count;
+    
+    std::vector<Face>       kept;       // inside every plane so far
+    std::vector<Face>       discarded;  // subject's surface cut away
+    // every edge which has been split, and the vertex splitting it
+    std::unordered_map<uint64_t, uint>  splits;
+};
+
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::ConvexProblem::run()
+{
+    double maxMag = 0.0;
+    for(Mesh *mesh : operands) {
+        for(VertData &v : mesh->verts)
+            maxMag = std::max(maxMag, max(abs(v.pos)));
+    }
+    Quantization::callibrate(maxMag);
+    tol = CONVEX_FLATNESS * maxMag;
+    
+    std::vector<Vec3d> qpos[2];
+    std::vector<uint> groups[2];
+    uint nplanes[2] = { 0, 0 };
+    for(uint k=0; k<2; k++) {
+        Mesh *mesh = operands[k];
+        qpos[k].resize(mesh->verts.size());
+        for(uint i=0; i<mesh->verts.size(); i++) {
+            const Vec3d &raw = mesh->verts[i].pos;
+            for(uint j=0; j<3; j++)
+                qpos[k][i].v[j] = Quantization::quantize(raw.v[j]);
+        }
+        if(!mesh->convexFaceGroups(qpos[k], tol, &groups[k]))
+            return false;
+        for(uint tid=0; tid<groups[k].size(); tid++)
+            if(groups[k][tid] == tid)   nplanes[k]++;
+    }
+    
+    // an intersection may clip either operand with the other
+    uint c = 1;
+    if(op == BOOL_ISCT && nplanes[0] < nplanes[1])
+        c = 0;
+    if(nplanes[c] > CONVEX_MAX_PLANES)
+        return false;
+    Mesh *clipper = operands[c];
+    subject = operands[1-c];
+    
+    pos = qpos[1-c];
+    side.resize(pos.size(), 0);
+    dist.resize(pos.size(), 0.0);
+    stamp.resize(pos.size(), 0);
+    kept.resize(subject->tris.size());
+    for(uint tid=0; tid<subject->tris.size(); tid++) {
+        const Tri &tri = subject->tris[tid];
+        kept[tid].v.assign(tri.v, tri.v + 3);
+        kept[tid].data = tri.data;
+        kept[tid].cap  = false;
+    }
+    
+    // clip by one plane per group of coplanar triangles
+    for(uint tid=0; tid<clipper->tris.size() && !kept.empty(); tid++) {
+        if(groups[c][tid] != tid)   continue;
+        const Tri &tri = clipper->tris[tid];
+        ConvexPlane plane(qpos[c][tri.a], qpos[c][tri.b], qpos[c][tri.c]);
+        plane_count++;
+        if(!clip(plane, tri.data))
+            return false;
+    }
+    
+    if(op == BOOL_ISCT) {
+        emit(kept);
+    } else if(!kept.empty()) {
+        // what was cut off lhs, closed by the caps facing inwards
+        for(Face &face : kept) {
+            if(!face.cap)   continue;
+            std::reverse(face.v.begin(), face.v.end());
+            discarded.push_back(face);
+        }
+        emit(discarded);
+    }   // else the operands do not overlap, and lhs stays as it was
+    return true;
+}
+
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::ConvexProblem::clip(
+    const ConvexPlane &plane, const TriData &cap_data
+) {
+    // classify the vertices still in use
+    bool any_in = false;
+    bool any_out = false;
+    for(const Face &face : kept) {
+        for(uint v : face.v) {
+            if(stamp[v] != plane_count) {
+                stamp[v] = plane_count;
+                side[v] = plane.side(pos[v], tol);
+                dist[v] = plane.distance(pos[v]);
+            }
+            any_in  = any_in  || side[v] < 0;
+            any_out = any_out || side[v] > 0;
+        }
+    }
+    if(!any_out)    return true;
+    if(!any_in) {   // no volume is left
+        for(Face &face : kept)
+            if(!face.cap)   discarded.push_back(face);
+        kept.clear();
+        return true;
+    }
+    
+    std::vector<Face> next;
+    next.reserve(kept.size());
+    for(Face &face : kept) {
+        const std::vector<uint> &v = face.v;
+        uint n = v.size();
+        // A convex face is cut at most twice, into two polygons which
+        // share the cut.  If rounding has bent a face so that it is cut
+        // more often, the pieces are still polygons, but bridged along
+        // the plane, and the ones cut away no longer fit the rest.
+        // Those only matter for a difference, and only off the caps
+        uint changes = 0;
+        int last = 0;
+        bool has_in = false, has_out = false;
+        for(uint k=0; k<=n; k++) {
+            int s = side[v[k%n]];
+            if(s == 0)  continue;
+            if(last != 0 && s != last)  changes++;
+            last = s;
+            has_in  = has_in  || s < 0;
+            has_out = has_out || s > 0;
+        }
+        if(changes > 2 && op == BOOL_DIFF && !face.cap)
+            return false;
+        if(!has_out) {
+            next.push_back(std::move(face));
+            continue;
+        }
+        
+        Face in_face, out_face;
+        in_face.data = out_face.data = face.data;
+        in_face.cap  = out_face.cap  = face.cap;
+        for(uint k=0; k<n; k++) {
+            uint a = v[k];
+            uint b = v[(k+1)%n];
+            if(side[a] <= 0)    in_face.v.push_back(a);
+            if(side[a] >= 0)    out_face.v.push_back(a);
+            if(side[a] * side[b] < 0) {
+                uint x = crossing(a, b);
+                in_face.v.push_back(x);
+                out_face.v.push_back(x);
+            }
+        }
+        if(in_face.v.size() >= 3)
+            next.push_back(std::move(in_face));
+        if(out_face.v.size() >= 3 && !face.cap)
+            discarded.push_back(std::move(out_face));
+    }
+    kept.swap(next);
+    
+    // The cut leaves a hole bounded by the edges lying on the plane
+    // which are now used only one way.  The body was convex, so there
+    // is normally one; rounding of the new vertices can pinch off more
+    std::unordered_map<uint64_t, bool> on_edges;
+    for(const Face &face : kept) {
+        uint n = face.v.size();
+        for(uint k=0; k<n; k++) {
+            uint a = face.v[k];
+            uint b = face.v[(k+1)%n];
+            if(side[a] == 0 && side[b] == 0)
+                on_edges[convexEdgeKey(a, b)] = true;
+        }
+    }
+    std::unordered_map<uint, uint> loop_next;
+    for(const auto &entry : on_edges) {
+        uint a = uint(entry.first >> 32);
+        uint b = uint(entry.first & 0xFFFFFFFFu);
+        if(on_edges.count(convexEdgeKey(b, a)))     continue;
+        if(!loop_next.insert(std::make_pair(a, b)).second)
+            return false;
+    }
+    if(loop_next.empty())
+        return false;
+    
+    // and each is closed by a cap face, running the other way
+    while(!loop_next.empty()) {
+        Face cap;
+        cap.data = cap_data;
+        cap.cap  = true;
+        uint start = loop_next.begin()->first;
+        uint cur = start;
+        do {
+            auto it = loop_next.find(cur);
+            if(it == loop_next.end())
+                return false;
+            cap.v.push_back(cur);
+            cur = it->second;
+            loop_next.erase(it);
+        } while(cur != start);
+        if(cap.v.size() < 3)
+            return false;
+        std::reverse(cap.v.begin(), cap.v.end());
+        kept.push_back(std::move(cap));
+    }
+    return true;
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::ConvexProblem::crossing(uint a, uint b)
+{
+    uint64_t key = convexSegKey(a, b);
+    auto it = splits.find(key);
+    if(it != splits.end())
+        return it->second;
+    
+    double t = dist[a] / (dist[a] - dist[b]);
+    uint x = addVert(pos[a] + t * (pos[b] - pos[a]));
+    splits[key] = x;
+    return x;
+}
+
+// appends a and the vertices splitting edge ab, in order, but not b
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::ConvexProblem::expandEdge(
+    uint a, uint b, std::vector<uint> &poly
+) {
+    auto it = splits.find(convexSegKey(a, b));
+    if(it == splits.end()) {
+        poly.push_back(a);
+    } else {
+        expandEdge(a, it->second, poly);
+        expandEdge(it->second, b, poly);
+    }
+}
+
+// the corner of the convex polygon to fan it from which gives the
+// best shaped triangles; -1 if every fan would have a flat one
+template<class VertData, class TriData>
+int Mesh<VertData,TriData>::ConvexProblem::fanApex(
+    const std::vector<uint> &poly
+) {
+    // twice the area over the longest edge squared; 0 when flat
+    auto shape = [&](uint a, uint b, uint c) {
+        Vec3d pa = pos[a], pb = pos[b], pc = pos[c];
+        double longest = std::max(len2(pb - pa),
+                         std::max(len2(pc - pb), len2(pa - pc)));
+        return len(cross(pb - pa, pc - pa)) / longest;
+    };
+    uint n = poly.size();
+    int best = -1;
+    double best_shape = 1.0e-6;
+    for(uint i=0; i<n; i++) {
+        double worst = 1.0;
+        for(uint k=1; k+1<n && worst > best_shape; k++)
+            worst = std::min(worst, shape(poly[i], poly[(i+k)%n],
+                                                   poly[(i+k+1)%n]));
+        if(worst > best_shape) {
+            best = i;
+            best_shape = worst;
+        }
+    }
+    return best;
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::ConvexProblem::emit(std::vector<Face> &faces)
+{
+    // A face cut away early keeps its edges as they were, while its
+    // neighbor may have been split further along them, so the splits
+    // are filled in first.  Polygons are fanned from a corner, or
+    // around their centroid if every corner would give flat triangles
+    std::vector<Tri> new_tris;
+    std::vector<uint> poly;
+    for(const Face &face : faces) {
+        poly.clear();
+        uint n = face.v.size();
+        for(uint k=0; k<n; k++)
+            expandEdge(face.v[k], face.v[(k+1)%n], poly);
+        n = poly.size();
+        Tri tri;
+        tri.data = face.data;
+        int apex = (n == 3)? 0 : fanApex(poly);
+        if(apex >= 0) {
+            tri.a = poly[apex];
+            for(uint k=1; k+1<n; k++) {
+                tri.b = poly[(apex+k)%n];
+                tri.c = poly[(apex+k+1)%n];
+                new_tris.push_back(tri);
+            }
+            continue;
+        }
+        Vec3d center(0,0,0);
+        for(uint v : poly)
+            center += pos[v];
+        tri.a = addVert(center / double(n));
+        for(uint k=0; k<n; k++) {
+            tri.b = poly[k];
+            tri.c = poly[(k+1)%n];
+            new_tris.push_back(tri);
+        }
+    }
+    
+    // keep only the vertices in use
+    uint nsubject = subject->verts.size();
+    std::vector<uint> remap(pos.size(), uint(-1));
+    std::vector<VertData> new_verts;
+    for(Tri &tri : new_tris) {
+        for(uint k=0; k<3; k++) {
+            uint &v = tri.v[k];
+            if(remap[v] == uint(-1)) {
+                remap[v] = new_verts.size();
+                new_verts.push_back((v < nsubject)? subject->verts[v]
+                                                  : VertData());
+                new_verts.back().pos = pos[v];
+            }
+            v = remap[v];
+        }
+    }
+    Mesh *result = operands[0];
+    result->verts.swap(new_verts);
+    result->tris.swap(new_tris);
+    result->convexity = CONVEXITY_UNKNOWN;
+}
+
+
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::boolConvex(Mesh &rhs, BoolOp op,
+                                        uint *slivers)
+{
+    if(!bool_options.convexKernel || bool_options.validateInputs)
+        return false;
+    if(op != BOOL_ISCT && op != BOOL_DIFF)
+        return false;
+    if(!isConvex() || !rhs.isConvex())
+        return false;
+    
+    ConvexProblem cprob(this, &rhs, op);
+    if(!cprob.run())
+        return false;
+    
+    *slivers = 0;
+    if(bool_options.cleanSlivers)
+        *slivers = cleanSlivers(bool_options.sliverAngle);
+    return true;
+}
@@ -0,0 +1,375 @@
+// +-------------------------------------------------------------------------
+// | mesh.cut.tpp
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+// Cutting a solid by a plane.  Each triangle is visited once, and
+// split where it crosses the plane; the hole that leaves is closed
+// by a flat cap, triangulated by Triangle.  Only the cap costs more
+// than linear time, in the size of the cross section.
+
+
+// Vertices closer to the cutting plane than this (relative to the
+// largest coordinate) count as lying on it
+const double CUT_FLATNESS = 1e-9;
+
+// Triangulates the region of a plane bounded by the given segments,
+// each of which runs counter-clockwise around the region as seen from
+// the front of the plane.  Returns false if Triangle had to add
+// points, or if the inside could not be told apart from the outside
+inline bool cutTriangulateCap(
+    const std::vector<Vec3d> &points,
+    const std::vector< std::pair<uint,uint> > &segments,
+    const Vec3d &normal,
+    std::vector<uint> *cap_tris
+) {
+    if(points.size() < 3)
+        return false;
+    
+    // project onto the plane, so that counter-clockwise stays so
+    uint normdim = maxDim(abs(normal));
+    uint dim0 = (normdim+1)%3;
+    uint dim1 = (normdim+2)%3;
+    double sign_flip = (normal.v[normdim] < 0.0)? -1.0 : 1.0;
+    
+    std::vector<REAL> pointlist(points.size() * 2);
+    for(uint k=0; k<points.size(); k++) {
+        pointlist[k*2 + 0] = points[k].v[dim0];
+        pointlist[k*2 + 1] = points[k].v[dim1] * sign_flip;
+    }
+    std::vector<int> segmentlist(segments.size() * 2);
+    std::unordered_set<uint64_t> directed;
+    for(uint k=0; k<segments.size(); k++) {
+        segmentlist[k*2 + 0] = segments[k].first;
+        segmentlist[k*2 + 1] = segments[k].second;
+        directed.insert(convexEdgeKey(segments[k].first,
+                                      segments[k].second));
+    }
+    
+    struct triangulateio in = {}, out = {};
+    in.numberofpoints   = points.size();
+    in.pointlist        = pointlist.data();
+    in.numberofsegments = segments.size();
+    in.segmentlist      = segmentlist.data();
+    
+    char *params = (char*)("pznQYY");
+    {
+        std::lock_guard<std::mutex> lock(triangleMutex());
+        triangulate(params, &in, &out, nullptr);
+    }
+    
+    bool ok = (out.numberofpoints == in.numberofpoints);
+    uint ntris = (ok)? out.numberoftriangles : 0;
+    
+    // A triangle with a segment among its (counter-clockwise) edges is
+    // inside, and one with a segment reversed is outside.  That spreads
+    // to the neighbors across edges which are not segments
+    std::vector<int> inside(ntris, 0);
+    std::vector<uint> stack;
+    for(uint t=0; t<ntris && ok; t++) {
+        for(uint k=0; k<3; k++) {
+            uint a = out.trianglelist[t*3 + k];
+            uint b = out.trianglelist[t*3 + (k+1)%3];
+            int label = 0;
+            if(directed.count(convexEdgeKey(a, b)))         label =  1;
+            else if(directed.count(convexEdgeKey(b, a)))    label = -1;
+            if(label == 0)                  continue;
+            if(inside[t] == -label)         ok = false;
+            inside[t] = label;
+        }
+        if(inside[t] != 0)
+            stack.push_back(t);
+    }
+    while(!stack.empty() && ok) {
+        uint t = stack.back();
+        stack.pop_back();
+        for(uint k=0; k<3; k++) {
+            int n = out.neighborlist[t*3 + k];  // opposite corner k
+            if(n < 0)   continue;
+            uint a = out.trianglelist[t*3 + (k+1)%3];
+            uint b = out.trianglelist[t*3 + (k+2)%3];
+            if(directed.count(convexEdgeKey(a, b)) ||
+               directed.count(convexEdgeKey(b, a)))
+                continue;
+            if(inside[n] == 0) {
+                inside[n] = inside[t];
+                stack.push_back(n);
+            } else if(inside[n] != inside[t]) {
+                ok = false;
+            }
+        }
+    }
+    
+    cap_tris->clear();
+    for(uint t=0; t<ntris && ok; t++) {
+        if(inside[t] <= 0)  continue;
+        for(uint k=0; k<3; k++)
+            cap_tris->push_back(out.trianglelist[t*3 + k]);
+    }
+    ok = ok && !cap_tris->empty();
+    
+    free(out.pointlist);
+    free(out.pointmarkerlist);
+    free(out.trianglelist);
+    free(out.neighborlist);
+    free(out.segmentlist);
+    free(out.segmentmarkerlist);
+    return ok;
+}
+
+
+template<class VertData, class TriData>
+uint Mesh<VertData,TriData>::cutByPlane(const Vec3d &normal, double offset)
+{
+    double length = len(normal);
+    if(length == 0.0) {
+        CORK_ERROR("cutByPlane() was given a zero normal");
+        return 0;
+    }
+    Vec3d n = normal / length;
+    offset /= length;
+    
+    double maxMag = fabs(offset);
+    for(VertData &v : verts)
+        maxMag = std::max(maxMag, max(abs(v.pos)));
+    double tol = CUT_FLATNESS * maxMag;
+    
+    // which side of the plane each vertex is on is decided once,
+    // and everything else follows from that
+    std::vector<VertData> new_verts = verts;
+    std::vector<double> dist(verts.size());
+    std::vector<int> side(verts.size());
+    bool any_in = false;
+    bool any_out = false;
+    for(uint i=0; i<verts.size(); i++) {
+        dist[i] = dot(n, verts[i].pos) + offset;
+        side[i] = (fabs(dist[i]) <= tol)?   0 :
+                  (dist[i] > 0.0)?          1 : -1;
+        any_in  = any_in  || side[i] < 0;
+        any_out = any_out || side[i] > 0;
+    }
+    if(!any_out)
+        return 0;
+    if(!any_in) {
+        verts.clear();
+        tris.clear();
+        convexity = CONVEXITY_UNKNOWN;
+        return 0;
+    }
+    
+    // every edge which has been split, and the vertex splitting it
+    std::unordered_map<uint64_t, uint> splits;
+    auto crossing = [&](uint a, uint b) -> uint {
+        uint64_t key = convexSegKey(a, b);
+        auto it = splits.find(key);
+        if(it != splits.end())
+            return it->second;
+        // always from the inner end, so that copies of an edge
+        // between duplicated vertices are split at the same point
+        if(side[a] > 0)
+            std::swap(a, b);
+        double t = dist[a] / (dist[a] - dist[b]);
+        VertData v;
+        v.pos = verts[a].pos + t * (verts[b].pos - verts[a].pos);
+        new_verts.push_back(v);
+        side.push_back(0);
+        splits[key] = new_verts.size() - 1;
+        return new_verts.size() - 1;
+    };
+    
+    std::vector<Tri> new_tris;
+    new_tris.reserve(tris.size());
+    uint poly[4];
+    for(const Tri &tri : tris) {
+        bool has_in = false;
+        bool has_out = false;
+        for(uint k=0; k<3; k++) {
+            has_in  = has_in  || side[tri.v[k]] < 0;
+            has_out = has_out || side[tri.v[k]] > 0;
+        }
+        if(!has_out) {
+            // a triangle lying in the plane stays if it faces out of
+            // the part kept, and it then covers part of the cap
+            if(!has_in) {
+                const Vec3d &p0 = verts[tri.a].pos;
+                Vec3d tn = cross(verts[tri.b].pos - p0, verts[tri.c].pos - p0);
+                if(dot(tn, n) < 0.0)
+                    continue;
+            }
+            new_tris.push_back(tri);
+            continue;
+        }
+        if(!has_in)
+            continue;
+        
+        // the part inside is a triangle or a quad
+        uint np = 0;
+        for(uint k=0; k<3; k++) {
+            uint a = tri.v[k];
+            uint b = tri.v[(k+1)%3];
+            if(side[a] <= 0)
+                poly[np++] = a;
+            if(side[a] * side[b] < 0)
+                poly[np++] = crossing(a, b);
+        }
+        Tri piece;
+        piece.data = tri.data;
+        if(np == 3) {
+            piece.a = poly[0]; piece.b = poly[1]; piece.c = poly[2];
+            new_tris.push_back(piece);
+            continue;
+        }
+        // split the quad along its shorter diagonal
+        uint s = (len2(new_verts[poly[0]].pos - new_verts[poly[2]].pos) <=
+                  len2(new_verts[poly[1]].pos - new_verts[poly[3]].pos))?
+                 0 : 1;
+        piece.a = poly[s]; piece.b = poly[s+1]; piece.c = poly[s+2];
+        new_tris.push_back(piece);
+        piece.a = poly[s]; piece.b = poly[s+2]; piece.c = poly[(s+3)%4];
+        new_tris.push_back(piece);
+    }
+    
+    // The hole is bounded by the edges in the plane which the kept
+    // triangles use only one way.  Vertices in the plane are welded by
+    // position first, so that meshes stored with duplicated vertices
+    // along seams still close up
+    std::map<std::tuple<double,double,double>, uint> welded;
+    std::vector<uint> cap_id(new_verts.size(), uint(-1));
+    std::vector<uint> cap_verts;
+    auto capId = [&](uint v) -> uint {
+        if(cap_id[v] == uint(-1)) {
+            const Vec3d &p = new_verts[v].pos;
+            auto ins = welded.insert(std::make_pair(
+                            std::make_tuple(p.x, p.y, p.z),
+                            uint(cap_verts.size())));
+            if(ins.second)
+                cap_verts.push_back(v);
+            cap_id[v] = ins.first->second;
+        }
+        return cap_id[v];
+    };
+    std::unordered_set<uint64_t> on_edges;
+    for(const Tri &tri : new_tris) {
+        for(uint k=0; k<3; k++) {
+            uint a = tri.v[k];
+            uint b = tri.v[(k+1)%3];
+            if(side[a] != 0 || side[b] != 0)    continue;
+            uint ca = capId(a);
+            uint cb = capId(b);
+            if(ca != cb)
+                on_edges.insert(convexEdgeKey(ca, cb));
+        }
+    }
+    // the cap runs along each of them the other way
+    std::vector< std::pair<uint,uint> > segments;
+    for(uint64_t key : on_edges) {
+        uint a = uint(key >> 32);
+        uint b = uint(key & 0xFFFFFFFFu);
+        if(!on_edges.count(convexEdgeKey(b, a)))
+            segments.push_back(std::make_pair(b, a));
+    }
+    
+    if(!segments.empty()) {
+        std::vector<Vec3d> points(cap_verts.size());
+        for(uint k=0; k<cap_verts.size(); k++)
+            points[k] = new_verts[cap_verts[k]].pos;
+        std::vector<uint> cap_tris;
+        if(!cutTriangulateCap(points, segments, n, &cap_tris)) {
+            // the section is too degenerate to cap cleanly
+            // (e.g. it pinches to a point); subtract a box instead
+            Mesh box = halfSpaceBox(n, offset);
+            return boolDiff(box);
+        }
+        Tri cap;
+        cap.data = TriData();
+        for(uint k=0; k<cap_tris.size(); k+=3) {
+            cap.a = cap_verts[cap_tris[k+0]];
+            cap.b = cap_verts[cap_tris[k+1]];
+            cap.c = cap_verts[cap_tris[k+2]];
+            new_tris.push_back(cap);
+        }
+    }
+    
+    // keep only the vertices in use
+    std::vector<uint> remap(new_verts.size(), uint(-1));
+    verts.clear();
+    for(Tri &tri : new_tris) {
+        for(uint k=0; k<3; k++) {
+            uint &v = tri.v[k];
+            if(remap[v] == uint(-1)) {
+                remap[v] = verts.size();
+                verts.push_back(new_verts[v]);
+            }
+            v = remap[v];
+        }
+    }
+    tris.swap(new_tris);
+    convexity = CONVEXITY_UNKNOWN;
+    
+    if(bool_options.cleanSlivers)
+        return cleanSlivers(bool_options.sliverAngle);
+    return 0;
+}
+
+// a box with its bottom on the plane, covering the half-space in
+// front of it as far as the mesh reaches
+template<class VertData, class TriData>
+Mesh<VertData,TriData> Mesh<VertData,TriData>::halfSpaceBox(
+    const Vec3d &n, double offset
+) {
+    BBox3d box;
+    for(VertData &v : verts)
+        box = convex(box, BBox3d(v.pos, v.pos));
+    Vec3d center = (box.minp + box.maxp) / 2.0;
+    double r = len(box.maxp - box.minp) + 1.0;
+    center -= (dot(n, center) + offset) * n;
+    
+    Vec3d u = cross(n, (fabs(n.x) < 0.9)? Vec3d(1,0,0) : Vec3d(0,1,0));
+    u /= len(u);
+    Vec3d w = cross(n, u);
+    
+    Mesh result;
+    result.verts.resize(8);
+    for(uint i=0; i<8; i++) {
+        result.verts[i].pos = center + ((i&1)? r : -r) * u
+                                     + ((i&2)? r : -r) * w
+                                     + ((i&4)? 2.0*r : 0.0) * n;
+    }
+    static const uint faces[12][3] = {
+        {0,2,3}, {0,3,1},   {4,5,7}, {4,7,6},
+        {0,1,5}, {0,5,4},   {2,6,7}, {2,7,3},
+        {0,4,6}, {0,6,2},   {1,3,7}, {1,7,5},
+    };
+    result.tris.resize(12);
+    for(uint t=0; t<12; t++) {
+        for(uint k=0; k<3; k++)
+            result.tris[t].v[k] = faces[t][k];
+        result.tris[t].data = TriData();
+    }
+    return result;
+}
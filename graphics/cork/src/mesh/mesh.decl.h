@@ -33,9 +33,11 @@
 
 #include "vec.h"
 #include "ray.h"
+#include "bbox.h"
 #include "shortVec.h"
 
 #include "iterPool.h"
+#include "broadPhase.h"
 
 
 struct BoolVertexData {
@@ -118,11 +120,53 @@ struct RemeshOptions
     double minEdgeLength;
     double minAngle;
     double maxAngle;
+    // work budgets; remeshing stops early once either is exhausted
+    uint   maxOperations;   // 0 means 10 operations per input edge
+    double maxSeconds;      // wall-clock limit; <= 0.0 means no limit
     RemeshOptions() :
         maxEdgeLength(1.0),
         minEdgeLength(0.3),
         minAngle(5.0),
-        maxAngle(170.0)
+        maxAngle(170.0),
+        maxOperations(0),
+        maxSeconds(0.0)
+    {}
+};
+
+
+struct BoolOptions
+{
+    // after each Boolean op, collapse away triangles with an angle
+    // below sliverAngle (degrees); see Mesh::cleanSlivers()
+    bool   cleanSlivers;
+    double sliverAngle;
+    // inputs that are not closed may cross themselves (the language's
+    // own primitives, stored with their seams open, do), so every pair
+    // of their triangles is searched for crossings.  Closed inputs are
+    // taken to be solid and not self-intersecting, and only crossings
+    // between the operands, near where their boxes overlap, are
+    // searched for; solidInputs vouches for that without checking.
+    // Validating searches every pair even of operands that cannot
+    // touch, closed or not
+    bool   solidInputs;
+    bool   validateInputs;
+    // when every connected component is closed, operate on each group
+    // of overlapping components separately (and concurrently, on up to
+    // threads threads; 0 picks one per core), passing untouched
+    // components straight through
+    bool   byComponents;
+    uint   threads;
+    // intersect or subtract two convex operands by clipping one with
+    // the face planes of the other, rather than in general
+    bool   convexKernel;
+    BoolOptions() :
+        cleanSlivers(true),
+        sliverAngle(5.0),
+        solidInputs(false),
+        validateInputs(false),
+        byComponents(true),
+        threads(0),
+        convexKernel(true)
     {}
 };
 
@@ -170,9 +214,21 @@ public:
         std::function<void(TriData &t,
                            VertData &, VertData &, VertData &)> each_tri
     );
+    // templated visitor versions of the above;
+    // lambdas bind to these and get inlined into the loops
+    template<class Func>
+    inline void for_verts(Func func);
+    template<class Func>
+    inline void for_tris(Func func);
+    template<class StartFunc, class TriFunc>
+    inline void for_edges(StartFunc start, TriFunc each_tri);
     
     // form the disjoint union of two meshes
     void disjointUnion(const Mesh &cp);
+    // merge vertices at exactly the same position, as in meshes stored
+    // with their vertices repeated along seams, dropping any triangles
+    // that collapse
+    void weldVertices();
     
     struct Isct {
         Ray3d   ray;
@@ -189,17 +245,46 @@ public:
     
     // checks if the mesh is closed
     bool isClosed();
+    // checks if the mesh bounds a convex solid.  The answer is cached
+    // until the mesh is next changed through its own methods
+    bool isConvex();
     
 public: // REMESHING module
     // REQUIRES:
     //  - MinimalData
     //  - RemeshData
     void remesh();
+    // quadric error edge collapse; only performs collapses that move
+    // the surface by less than (roughly) tolerance and that keep a
+    // closed manifold closed and manifold.  Vertices are welded first
+    // (see weldVertices()), as seams otherwise count as boundaries
+    // and nothing along them collapses.  Honors the work budgets
+    // in remesh_options.
+    void simplify(double tolerance);
+    // collapses the shortest edge of triangles with an angle below
+    // min_angle (degrees), under the same guarantees as simplify().
+    // returns the number of triangles removed
+    uint cleanSlivers(double min_angle);
     RemeshOptions remesh_options;
     
 public: // ISCT (intersections) module
     void resolveIntersections(); // makes all intersections explicit
-    bool isSelfIntersecting(); // is the mesh self-intersecting?
+    // narrows down which edge-triangle pairs are searched; the caller
+    // guarantees that no intersections are missed by doing so
+    struct IsctSearch {
+        // if given, only elements touching this box are searched
+        const BBox3d            *region;
+        // if given, an operand label for every triangle; only pairs
+        // with an edge and triangle from different operands are searched
+        const std::vector<byte> *operands;
+        // which broad phase structure to index the edges with
+        BroadPhaseKind          broadPhase;
+        IsctSearch() :
+            region(nullptr), operands(nullptr),
+            broadPhase(BROAD_PHASE_AUTO)
+        {}
+    };
+    void resolveIntersections(const IsctSearch &search);
     // TESTING
     void testingComputeStaticIsctPoints(std::vector<Vec3d> *points);
     void testingComputeStaticIsct(std::vector<Vec3d> *points,
@@ -208,10 +293,96 @@ public: // ISCT (intersections) module
 public: // BOOLean operation module
     // all of the form
     //      this = this OP rhs
-    void boolUnion(Mesh &rhs);
-    void boolDiff(Mesh &rhs);
-    void boolIsct(Mesh &rhs);
-    void boolXor(Mesh &rhs);
+    // returning the number of sliver triangles cleaned up afterwards
+    uint boolUnion(Mesh &rhs);
+    uint boolDiff(Mesh &rhs);
+    uint boolIsct(Mesh &rhs);
+    uint boolXor(Mesh &rhs);
+    // computes any of the four results above from a single
+    // intersection resolution (per group of components, where they
+    // are solved apart); pass nullptr to skip a result.  The convex
+    // kernel still computes the results it applies to on its own.
+    // this is left as it was (unless passed as one of the results)
+    uint boolAll(Mesh &rhs,
+                 Mesh *union_out, Mesh *diff_out,
+                 Mesh *isct_out, Mesh *xor_out);
+    // N-ary forms: this = this OP rhs[0] OP rhs[1] ...
+    // resolving all of the intersections in one pass
+    // (the meshes in rhs are left with their triangles relabeled)
+    uint boolUnionN(std::vector<Mesh*> &rhs);
+    uint boolIsctN(std::vector<Mesh*> &rhs);
+    BoolOptions bool_options;
+    // TESTING
+    uint testingBoolEdgeCache(); // returns # of isct edge visits
+    
+public: // QUERY module
+    // do the solids bounded by this and rhs overlap (or touch)?
+    // Stops at the first crossing of the two surfaces found; failing
+    // that, checks whether either solid contains a piece of the other
+    bool intersects(Mesh &rhs);
+    // does the surface cross itself, other than where triangles share
+    // vertices?  Searched for on up to threads threads (0 picks one per
+    // core), stopping at the first crossing found.  Degenerate contacts
+    // count, as they may hide one (*degenerate tells, if given)
+    bool isSelfIntersecting(uint threads = 0, bool *degenerate = nullptr);
+    // isClosed() and isSelfIntersecting(), run side by side
+    void checkSolid(uint threads, bool *closed, bool *self_intersecting,
+                    bool *degenerate);
+
+    // An index over the surface for asking many point and ray questions
+    // of one solid: it is built once, after which each query visits
+    // only the triangles near its answer.  It keeps its own copy of
+    // the surface, so the mesh may change or go away afterwards.
+    // Queries are const and may run concurrently; the batched forms
+    // spread themselves over up to threads threads (0: one per core)
+    class Query {
+    public:
+        Query(const Mesh &mesh);
+        ~Query();
+
+        // is p inside the solid? (does the surface wind around it?)
+        bool contains(const Vec3d &p) const;
+        // the first point along the ray where it meets the surface,
+        // as reported by Mesh::pick()
+        Isct pick(const Ray3d &ray) const;
+        // the point on the surface nearest p, and its triangle;
+        // an empty surface gives back p itself
+        Vec3d closestPoint(const Vec3d &p, uint *tri_id = nullptr) const;
+
+        void contains(const std::vector<Vec3d> &ps,
+                      std::vector<char> *inside, uint threads = 0) const;
+        void pick(const std::vector<Ray3d> &rays,
+                  std::vector<Isct> *iscts, uint threads = 0) const;
+        void closestPoint(const std::vector<Vec3d> &ps,
+                          std::vector<Vec3d> *closest,
+                          uint threads = 0) const;
+
+        // move the surface, x -> mat * x + offset (mat is 3x3, row
+        // major), as if the mesh had been moved and the query rebuilt;
+        // the index is refit in place instead
+        void transform(const double *mat, const Vec3d &offset);
+    private:
+        Query(const Query &);
+        Query& operator=(const Query &);
+        GeomBlob<uint> blob(uint tid) const;
+
+        // corners in increasing vertex id order (so that neighbouring
+        // triangles test their shared edges alike), and the outward
+        // normal that the original order gives
+        struct QTri {
+            Vec3d   p[3];
+            Vec3d   normal;
+        };
+        std::vector<QTri>   qtris;
+        AABVH<uint>         *bvh; // null if there are no triangles
+    };
+
+public: // CUT module
+    // removes the part in front of the plane  dot(normal, x) + offset = 0
+    // and closes the hole left behind with a flat cap, in a single pass
+    // over the triangles.  Sliver cleanup follows bool_options.
+    // returns the number of sliver triangles cleaned up afterwards
+    uint cutByPlane(const Vec3d &normal, double offset);
     
 private:    // Internal Formats
     struct Tri {
@@ -223,7 +394,7 @@ private:    // Internal Formats
             uint v[3];
         };
         
-        inline Tri() {}
+        inline Tri() : data(), v{0, 0, 0} {}
     };
     
     inline void merge_tris(uint tid_result, uint tid0, uint tid1);
@@ -258,6 +429,8 @@ private:    // caches
     
     // parallel to vertex array
     std::vector<uint> getComponentIds();
+    // one mesh per connected component
+    void splitIntoComponents(std::vector<Mesh> &parts);
     
     // like the neighbor cache, but more customizable
     template<class Edata>
@@ -265,8 +438,8 @@ private:    // caches
         uint                vid;
         ShortVec<uint, 2>   tids;
         Edata               data;
-        inline EGraphEntry() {}
-        inline EGraphEntry(uint vid_) : vid(vid_) {}
+        inline EGraphEntry() : data() {}
+        inline EGraphEntry(uint vid_) : vid(vid_), data() {}
     };
     template<class Edata>
     struct EGraphCache {
@@ -280,10 +453,9 @@ private:    // caches
             skeleton[i].push_back(EGraphEntry<Edata>(j));
             return skeleton[i][N];
         }
-        inline void for_each(std::function<void(
-                uint i, uint j, EGraphEntry<Edata> &entry
-            )> action
-        ) {
+        // action(uint i, uint j, EGraphEntry<Edata> &entry)
+        template<class Func>
+        inline void for_each(Func action) {
             for(uint i=0; i<skeleton.size(); i++) {
                 for(auto &entry : skeleton[i]) {
                     action(i, entry.vid, entry);
@@ -304,6 +476,28 @@ private:    // Isct Support
         //using Tprob = TriangleProblem*;
 private:    // Bool Support
     class BoolProblem;
+    enum BoolOp { BOOL_UNION, BOOL_DIFF, BOOL_ISCT, BOOL_XOR };
+    // this = this OP rhs, as one problem
+    uint boolDirect(Mesh &rhs, BoolOp op);
+    // *outs[op] = this OP rhs for each op given an output (indexed by
+    // BoolOp; nullptr skips it), as one problem
+    uint boolDirectAll(Mesh &rhs, Mesh *outs[4]);
+    // either, split up into groups of components which might interact
+    uint boolByComponents(Mesh &rhs, BoolOp op);
+    uint boolByComponents(Mesh &rhs, Mesh *outs[4]);
+    
+private:    // Convex Support
+    class ConvexProblem;
+    enum Convexity { CONVEXITY_UNKNOWN, CONVEX, NOT_CONVEX };
+    Convexity convexity;
+    bool convexFaceGroups(const std::vector<Vec3d> &qpos, double tol,
+                          std::vector<uint> *groups);
+    // this = this OP rhs by the convex kernel, if it applies
+    bool boolConvex(Mesh &rhs, BoolOp op, uint *slivers);
+    
+private:    // Cut Support
+    // a box covering the half-space cut away, as far as this reaches
+    Mesh halfSpaceBox(const Vec3d &n, double offset);
     
 private:    // Remeshing Support
     struct RemeshScratchpad;
@@ -318,11 +512,17 @@ private:    // Remeshing Support
                       bool collapsing_tetrahedra_disappear);
     
     // Need edge scoring routines...
-    void scoreAndEnqueue(
-        std::set< std::pair<double, Eptr> > &queue, Eptr edge);
-    void dequeue(
-        std::set< std::pair<double, Eptr> > &queue, Eptr edge);
+    void scoreAndEnqueue(RemeshScratchpad &, Eptr edge);
+    void dequeue(RemeshScratchpad &, Eptr edge);
     double computeEdgeScore(Eptr edge);
+    void runRemeshQueue(RemeshScratchpad &);
+    
+    // simplification support
+    double computeCollapseScore(RemeshScratchpad &, Eptr edge,
+                                Vec3d *placement = nullptr);
+    bool collapseFlipsTris(Eptr e, Vptr v, const Vec3d &p);
+    bool isSliverEdge(Eptr edge, double min_angle);
+    void runCollapses(RemeshScratchpad &);
     
     // support functions
     void populateTriFromTopoTri(Tptr t);
@@ -342,6 +542,14 @@ template<class VertData, class TriData>
 inline void Mesh<VertData,TriData>::for_verts(
     std::function<void(VertData &v)> func
 ) {
+    for_verts< std::function<void(VertData &)> & >(func);
+}
+
+template<class VertData, class TriData>
+template<class Func>
+inline void Mesh<VertData,TriData>::for_verts(Func func)
+{
+    convexity = CONVEXITY_UNKNOWN;
     for(auto &v : verts)
         func(v);
 }
@@ -350,6 +558,16 @@ template<class VertData, class TriData>
 inline void Mesh<VertData,TriData>::for_tris(
     std::function<void(TriData &, VertData &, VertData &, VertData &)> func
 ) {
+    for_tris< std::function<void(TriData &,
+                                 VertData &, VertData &, VertData &)> & >(
+        func);
+}
+
+template<class VertData, class TriData>
+template<class Func>
+inline void Mesh<VertData,TriData>::for_tris(Func func)
+{
+    convexity = CONVEXITY_UNKNOWN;
     for(auto &tri : tris) {
         auto &a = verts[tri.a];
         auto &b = verts[tri.b];
@@ -363,6 +581,17 @@ inline void Mesh<VertData,TriData>::for_edges(
     std::function<void(VertData &, VertData &)> start,
     std::function<void(TriData &t,
                        VertData &, VertData &, VertData &)> each_tri
+) {
+    for_edges< std::function<void(VertData &, VertData &)> &,
+               std::function<void(TriData &,
+                                  VertData &, VertData &, VertData &)> & >(
+        start, each_tri);
+}
+
+template<class VertData, class TriData>
+template<class StartFunc, class TriFunc>
+inline void Mesh<VertData,TriData>::for_edges(
+    StartFunc start, TriFunc each_tri
 ) {
     NeighborCache cache = createNeighborCache();
     for(uint i=0; i<cache.skeleton.size(); i++) {
@@ -48,6 +48,9 @@
 #include "mesh.remesh.tpp"
 #include "mesh.isct.tpp"
 #include "mesh.bool.tpp"
+#include "mesh.convex.tpp"
+#include "mesh.cut.tpp"
+#include "mesh.query.tpp"
 
 
 
@@ -32,12 +32,23 @@
 #include "empty3d.h"
 
 #include "aabvh.h"
+#include "arena.h"
+
+#include <mutex>
 
 #define REAL double
 extern "C" {
 #include "triangle.h"
 }
 
+// Triangle keeps a few globals (its error bounds and random seed),
+// so only one triangulation may run at a time
+inline std::mutex& triangleMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
 struct GenericVertType;
     struct IsctVertType;
     struct OrigVertType;
@@ -469,7 +480,10 @@ public:
         // solve the triangulation problem
         char *params = (char*)("pzQYY");
         //char *debug_params = (char*)("pzYYVC");
-        triangulate(params, &in, &out, nullptr);
+        {
+            std::lock_guard<std::mutex> lock(triangleMutex());
+            triangulate(params, &in, &out, nullptr);
+        }
         
         if(out.numberofpoints != in.numberofpoints) {
             std::cout << "out.numberofpoints: "
@@ -613,8 +627,24 @@ template<class VertData, class TriData>
 class Mesh<VertData,TriData>::IsctProblem : public TopoCache
 {
 public:
-    IsctProblem(Mesh *owner) : TopoCache(owner)
+    IsctProblem(Mesh *owner, const IsctSearch &search = IsctSearch()) :
+        TopoCache(owner),
+        glue_pts(scratch), tprobs(scratch),
+        ivpool(scratch), ovpool(scratch),
+        iepool(scratch), oepool(scratch),
+        sepool(scratch), gtpool(scratch),
+        restricted(search.region != nullptr),
+        operands(search.operands),
+        two_operands(false),
+        broad_phase(search.broadPhase)
     {
+        if(operands) {
+            byte max_label = 0;
+            for(byte label : *operands)
+                max_label = std::max(max_label, label);
+            two_operands = (max_label <= 1);
+        }
+        
         // initialize all the triangles to NOT have an associated tprob
         TopoCache::tris.for_each([](Tptr t) {
             t->data = nullptr;
@@ -622,11 +652,20 @@ public:
         
         // Callibrate the quantization unit...
         double maxMag = 0.0;
+        BBox3d bounds;
         for(VertData &v : TopoCache::mesh->verts) {
             maxMag = std::max(maxMag, max(abs(v.pos)));
+            bounds = convex(bounds, BBox3d(v.pos, v.pos));
         }
         Quantization::callibrate(maxMag);
         
+        if(restricted) {
+            double pad = searchPadding(bounds);
+            Vec3d padv(pad, pad, pad);
+            search_region = BBox3d(search.region->minp - padv,
+                                   search.region->maxp + padv);
+        }
+        
         // and use vertex auxiliary data to store quantized vertex coordinates
         uint N = TopoCache::mesh->verts.size();
         quantized_coords.resize(N);
@@ -804,10 +843,15 @@ public:
         // create edges as necessary...
     }*/
     
-    bool hasIntersections(); // test for iscts, exit if one is found
-    
     void findIntersections();
     void resolveAllIntersections();
+    
+    // how far apart triangles of a mesh within bounds can be and still
+    // be found crossing: the random perturbations applied over every
+    // retry can move them this close, and their quantized coordinates
+    // closer still.  The search region is grown by this much, and
+    // callers working out a region should treat boxes the same way
+    static double searchPadding(const BBox3d &bounds);
 private:
     // if we encounter ambiguous degeneracies, then this
     // routine returns false, indicating that the computation aborted.
@@ -822,20 +866,50 @@ public:
     void dumpIsctEdges(std::vector< std::pair<Vec3d,Vec3d> > *edges);
     
 protected: // DATA
-    IterPool<GluePointMarker>   glue_pts;
-    IterPool<TriangleProblem>   tprobs;
-    
-    IterPool<IsctVertType>      ivpool;
-    IterPool<OrigVertType>      ovpool;
-    IterPool<IsctEdgeType>      iepool;
-    IterPool<OrigEdgeType>      oepool;
-    IterPool<SplitEdgeType>     sepool;
-    IterPool<GenericTriType>    gtpool;
+    // All of the scratch objects below are carved out of one arena,
+    // which is released in bulk when the problem is reset or destroyed.
+    // (must be declared before the pools that draw from it)
+    Arena                       scratch;
+    
+    ArenaPool<GluePointMarker>  glue_pts;
+    ArenaPool<TriangleProblem>  tprobs;
+    
+    ArenaPool<IsctVertType>     ivpool;
+    ArenaPool<OrigVertType>     ovpool;
+    ArenaPool<IsctEdgeType>     iepool;
+    ArenaPool<OrigEdgeType>     oepool;
+    ArenaPool<SplitEdgeType>    sepool;
+    ArenaPool<GenericTriType>   gtpool;
 private:
     std::vector<Vec3d>          quantized_coords;
+    
+    // when restricted, only edges and triangles touching the
+    // search region are handed to the broad phase
+    bool                        restricted;
+    BBox3d                      search_region;
+    // when given, edges are only tested against other operands.
+    // With just two, each operand's edges are indexed separately
+    const std::vector<byte>     *operands;
+    bool                        two_operands;
+    inline uint operandOf(Tptr t) const {
+        return (operands)? (*operands)[t->ref] : 0;
+    }
+    inline uint operandOf(Eptr e) const {
+        return operandOf(e->tris[0]);
+    }
+    BroadPhaseKind              broad_phase;
+    
+    static constexpr double     PERTURB_EPSILON = 1.0e-5;
+    static constexpr int        MAX_TRYS        = 5;
 private:
-    inline void for_edge_tri(std::function<bool(Eptr e, Tptr t)>);
-    inline void bvh_edge_tri(std::function<bool(Eptr e, Tptr t)>);
+    // func(Eptr e, Tptr t) -> bool; returning false aborts the search
+    template<class Func>
+    inline void for_edge_tri(Func func);
+    template<class Func>
+    inline void bvh_edge_tri(Func func);
+    template<class Accel, class Func>
+    inline void accel_edge_tri(
+        const std::vector< GeomBlob<Eptr> > *edge_geoms, Func func);
 
     inline GeomBlob<Eptr> edge_blob(Eptr e);
     inline BBox3d bboxFromTptr(Tptr t);
@@ -866,10 +940,10 @@ private: // functions here to get around a GCC bug...
     void createRealTriangles(Tprob tprob, EdgeCache &ecache);
 };
 
-template<class T, uint LEN> inline
+template<class T, uint LEN, class Func> inline
 void for_pairs(
     ShortVec<T,LEN> &vec,
-    std::function<void(T&,T&)> func
+    Func func
 ) {
     for(uint i=0; i<vec.size(); i++)
         for(uint j=i+1; j<vec.size(); j++)
@@ -884,9 +958,10 @@ struct TriTripleTemp
     {}
 };
 
-template<class VertData, class TriData> inline
+template<class VertData, class TriData>
+template<class Func> inline
 void Mesh<VertData,TriData>::IsctProblem::for_edge_tri(
-    std::function<bool(Eptr e, Tptr t)> func
+    Func func
 ) {
     bool aborted = false;
     TopoCache::tris.for_each([&](Tptr t) {
@@ -910,28 +985,77 @@ GeomBlob<Eptr> Mesh<VertData,TriData>::IsctProblem::edge_blob(
     return blob;
 }
 
-template<class VertData, class TriData> inline
+template<class VertData, class TriData>
+template<class Func> inline
 void Mesh<VertData,TriData>::IsctProblem::bvh_edge_tri(
-    std::function<bool(Eptr e, Tptr t)> func
+    Func func
 ) {
-    std::vector< GeomBlob<Eptr> > edge_geoms;
+    // edge boxes, binned by operand if there are two of them
+    // (otherwise everything goes in the one bin)
+    std::vector< GeomBlob<Eptr> > edge_geoms[2];
     TopoCache::edges.for_each([&](Eptr e) {
-        edge_geoms.push_back(edge_blob(e));
+        GeomBlob<Eptr> blob = edge_blob(e);
+        if(!restricted || hasIsct(blob.bbox, search_region))
+            edge_geoms[(two_operands)? operandOf(e) : 0].push_back(blob);
     });
-    AABVH<Eptr> edgeBVH(edge_geoms);
+    
+    // pick the structure to index the edges with.  If the operands
+    // would be best served by different ones, their sizes differ a lot
+    BroadPhaseKind kind = broad_phase;
+    if(kind == BROAD_PHASE_AUTO) {
+        kind = chooseBroadPhase(edge_geoms[0]);
+        if(!edge_geoms[1].empty() &&
+           chooseBroadPhase(edge_geoms[1]) != kind)
+            kind = BROAD_PHASE_BVH;
+    }
+    switch(kind) {
+    case BROAD_PHASE_GRID:
+        accel_edge_tri< UniformGrid<Eptr> >(edge_geoms, func);
+        break;
+    case BROAD_PHASE_SAP:
+        accel_edge_tri< SweepAndPrune<Eptr> >(edge_geoms, func);
+        break;
+    default:
+        accel_edge_tri< AABVH<Eptr> >(edge_geoms, func);
+        break;
+    }
+}
+
+template<class VertData, class TriData>
+template<class Accel, class Func> inline
+void Mesh<VertData,TriData>::IsctProblem::accel_edge_tri(
+    const std::vector< GeomBlob<Eptr> > *edge_geoms,
+    Func func
+) {
+    Accel *edgeAccels[2] = { nullptr, nullptr };
+    for(uint k=0; k<2; k++) {
+        if(!edge_geoms[k].empty())
+            edgeAccels[k] = new Accel(edge_geoms[k]);
+    }
     
     // use the acceleration structure
     bool aborted = false;
     TopoCache::tris.for_each([&](Tptr t) {
+        Accel *edgeAccel = edgeAccels[(two_operands)? 1 - operandOf(t) : 0];
+        if(!edgeAccel)
+            return;
         // compute BBox
         BBox3d bbox = buildBox(t);
+        if(restricted && !hasIsct(bbox, search_region))
+            return;
+        bool same_operand_ok = (operands == nullptr || two_operands);
         if(!aborted) {
-            edgeBVH.for_each_in_box(bbox, [&](Eptr e) {
+            edgeAccel->for_each_in_box(bbox, [&](Eptr e) {
+                if(!same_operand_ok && operandOf(e) == operandOf(t))
+                    return;
                 if(!func(e,t))
                     aborted = true;
             });
         }
     });
+    
+    for(uint k=0; k<2; k++)
+        delete edgeAccels[k];
 }
 
 template<class VertData, class TriData>
@@ -1011,10 +1135,19 @@ bool Mesh<VertData,TriData>::IsctProblem::tryToFindIntersections()
     return true;
 }
 
+template<class VertData, class TriData>
+double Mesh<VertData,TriData>::IsctProblem::searchPadding(
+    const BBox3d &bounds
+) {
+    Vec3d extent = dim(bounds);
+    return 10.0 * PERTURB_EPSILON * MAX_TRYS +
+           1.0e-6 * std::max(extent.x, std::max(extent.y, extent.z));
+}
+
 template<class VertData, class TriData>
 void Mesh<VertData,TriData>::IsctProblem::perturbPositions()
 {
-    const double EPSILON = 1.0e-5; // perturbation epsilon
+    const double EPSILON = PERTURB_EPSILON;
     for(Vec3d &coord : quantized_coords) {
         Vec3d perturbation(Quantization::quantize(drand(-EPSILON, EPSILON)),
                            Quantization::quantize(drand(-EPSILON, EPSILON)),
@@ -1043,12 +1176,15 @@ void Mesh<VertData,TriData>::IsctProblem::reset()
     oepool.clear();
     sepool.clear();
     gtpool.clear();
+    
+    // every pool has been cleared, so the memory can be recycled
+    scratch.reset();
 }
 
 template<class VertData, class TriData>
 void Mesh<VertData,TriData>::IsctProblem::findIntersections()
 {
-    int nTrys = 5;
+    int nTrys = MAX_TRYS;
     perturbPositions(); // always perturb for safety...
     while(nTrys > 0) {
         if(!tryToFindIntersections()) {
@@ -1073,33 +1209,6 @@ void Mesh<VertData,TriData>::IsctProblem::findIntersections()
     });
 }
 
-template<class VertData, class TriData>
-bool Mesh<VertData,TriData>::IsctProblem::hasIntersections()
-{
-    bool foundIsct = false;
-    Empty3d::degeneracy_count = 0;
-    // Find some edge-triangle intersection point...
-    bvh_edge_tri([&](Eptr eisct, Tptr tisct)->bool{
-      if(checkIsct(eisct,tisct)) {
-        foundIsct = true;
-        return false; // break;
-      }
-      if(Empty3d::degeneracy_count > 0) {
-        return false; // break;
-      }
-      return true; // continue
-    });
-    
-    if(Empty3d::degeneracy_count > 0 || foundIsct) {
-        std::cout << "This self-intersection might be spurious. "
-                     "Degeneracies were detected." << std::endl;
-        return true;
-    } else {
-        return false;
-    }
-}
-
-
 template<class VertData, class TriData> inline
 BBox3d Mesh<VertData,TriData>::IsctProblem::buildBox(Eptr e) const
 {
@@ -1514,12 +1623,17 @@ void Mesh<VertData,TriData>::resolveIntersections()
 }
 
 template<class VertData, class TriData>
-bool Mesh<VertData,TriData>::isSelfIntersecting()
+void Mesh<VertData,TriData>::resolveIntersections(const IsctSearch &search)
 {
-    IsctProblem iproblem(this);
+    IsctProblem iproblem(this, search);
     
-    return iproblem.hasIntersections();
+    iproblem.findIntersections();
+    
+    iproblem.resolveAllIntersections();
+    
+    iproblem.commit();
 }
 
 
 
+
@@ -0,0 +1,592 @@
+// +-------------------------------------------------------------------------
+// | mesh.query.tpp
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include "empty3d.h"
+#include "quantization.h"
+
+#include "aabvh.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <thread>
+
+// Questions about the solids which meshes bound, answered without
+// changing them
+
+
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::intersects(Mesh &rhs)
+{
+    if(tris.empty() || rhs.tris.empty())
+        return false;
+    Mesh *meshes[2] = { this, &rhs };
+    
+    // the exact tests need both meshes at a common quantization
+    double maxMag = 0.0;
+    for(Mesh *mesh : meshes) {
+        for(VertData &v : mesh->verts)
+            maxMag = std::max(maxMag, max(abs(v.pos)));
+    }
+    Quantization::callibrate(maxMag);
+    
+    std::vector<Vec3d> qpos[2];
+    std::vector< GeomBlob<uint> > blobs[2];
+    BBox3d bounds[2];
+    for(uint k=0; k<2; k++) {
+        Mesh *mesh = meshes[k];
+        qpos[k].resize(mesh->verts.size());
+        for(uint i=0; i<mesh->verts.size(); i++) {
+            for(uint j=0; j<3; j++)
+                qpos[k][i].v[j] = Quantization::quantize(
+                                    mesh->verts[i].pos.v[j]);
+        }
+        blobs[k].resize(mesh->tris.size());
+        for(uint tid=0; tid<mesh->tris.size(); tid++) {
+            const Tri &tri = mesh->tris[tid];
+            Vec3d p0 = qpos[k][tri.a];
+            Vec3d p1 = qpos[k][tri.b];
+            Vec3d p2 = qpos[k][tri.c];
+            GeomBlob<uint> &blob = blobs[k][tid];
+            blob.bbox   = BBox3d(min(p0, min(p1, p2)), max(p0, max(p1, p2)));
+            blob.point  = (blob.bbox.minp + blob.bbox.maxp) / 2.0;
+            blob.id     = tid;
+            bounds[k]   = convex(bounds[k], blob.bbox);
+        }
+    }
+    if(!hasIsct(bounds[0], bounds[1]))
+        return false;
+    
+    AABVH<uint> bvh0(blobs[0]);
+    AABVH<uint> bvh1(blobs[1]);
+    AABVH<uint> *bvhs[2] = { &bvh0, &bvh1 };
+    
+    // do the surfaces cross (or touch) anywhere?  Two triangles do if
+    // an edge of either one passes through the other
+    auto edgesCross = [&](uint k, uint edge_tid, uint tri_tid) -> bool {
+        const Tri &etri = meshes[k]->tris[edge_tid];
+        const Tri &ttri = meshes[1-k]->tris[tri_tid];
+        Empty3d::TriEdgeIn input;
+        for(uint i=0; i<3; i++)
+            input.tri.p[i] = qpos[1-k][ttri.v[i]];
+        for(uint i=0; i<3; i++) {
+            input.edge.p[0] = qpos[k][etri.v[i]];
+            input.edge.p[1] = qpos[k][etri.v[(i+1)%3]];
+            if(!Empty3d::emptyExact(input))
+                return true;
+        }
+        return false;
+    };
+    if(bvh0.any_overlapping_pair(bvh1, [&](uint tid0, uint tid1) {
+        return edgesCross(0, tid0, tid1) || edgesCross(1, tid1, tid0);
+    }))
+        return true;
+    
+    // If not, each connected piece of either surface is entirely inside
+    // or outside the other solid, so one point of each piece decides.
+    // The winding number along a ray leaning in +x gives that, and only
+    // the triangles in a thin slab from the point to the far side count
+    for(uint k=0; k<2; k++) {
+        Mesh *mesh  = meshes[k];
+        Mesh *other = meshes[1-k];
+        const std::vector<Vec3d> &opos = qpos[1-k];
+        std::vector<uint> comps = mesh->getComponentIds();
+        std::vector<bool> tested(mesh->verts.size(), false);
+        for(const Tri &tri : mesh->tris) {
+            if(tested[comps[tri.a]])    continue;
+            tested[comps[tri.a]] = true;
+            
+            Ray3d r;
+            r.p = qpos[k][tri.a];
+            if(!isIn(r.p, bounds[1-k]))     continue;
+            r.r = Vec3d(1.0, drand(-0.2,0.2), drand(-0.2,0.2));
+            Vec3d end = r.p + std::max(0.0, bounds[1-k].maxp.x - r.p.x) * r.r;
+            BBox3d slab(min(r.p, end), max(r.p, end));
+            
+            int winding = 0;
+            bvhs[1-k]->for_each_in_box(slab, [&](uint otid) {
+                const Tri &otri = other->tris[otid];
+                uint a = otri.a, b = otri.b, c = otri.c;
+                double flip = 1.0;
+                // normalize vertex order (to prevent leaks)
+                if(a > b) { std::swap(a, b); flip = -flip; }
+                if(b > c) { std::swap(b, c); flip = -flip; }
+                if(a > b) { std::swap(a, b); flip = -flip; }
+                Vec3d va = opos[a], vb = opos[b], vc = opos[c];
+                double t;
+                Vec3d bary;
+                if(isct_ray_triangle(r, va, vb, vc, &t, &bary)) {
+                    Vec3d normal = flip * cross(vb - va, vc - va);
+                    winding += (dot(normal, r.r) > 0.0)? 1 : -1;
+                }
+            });
+            if(winding > 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+
+// Triangles are handed out to the search threads in runs of this many
+const uint SELF_ISCT_CHUNK = 256;
+// A degenerate edge-triangle test is retried up to this many times,
+// with the positions moved by up to this many quanta
+const int SELF_ISCT_TRYS = 5;
+const double SELF_ISCT_PERTURB = 64.0;
+
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::isSelfIntersecting(uint threads,
+                                                bool *degenerate)
+{
+    if(degenerate)  *degenerate = false;
+    if(tris.size() < 2)
+        return false;
+    
+    double maxMag = 0.0;
+    for(VertData &v : verts)
+        maxMag = std::max(maxMag, max(abs(v.pos)));
+    Quantization::callibrate(maxMag);
+    std::vector<Vec3d> qpos(verts.size());
+    for(uint i=0; i<verts.size(); i++) {
+        for(uint j=0; j<3; j++)
+            qpos[i].v[j] = Quantization::quantize(verts[i].pos.v[j]);
+    }
+    std::vector< GeomBlob<uint> > blobs(tris.size());
+    for(uint tid=0; tid<tris.size(); tid++) {
+        const Tri &tri = tris[tid];
+        Vec3d p0 = qpos[tri.a];
+        Vec3d p1 = qpos[tri.b];
+        Vec3d p2 = qpos[tri.c];
+        blobs[tid].bbox     = BBox3d(min(p0, min(p1, p2)),
+                                     max(p0, max(p1, p2)));
+        blobs[tid].point    = (blobs[tid].bbox.minp +
+                               blobs[tid].bbox.maxp) / 2.0;
+        blobs[tid].id       = tid;
+    }
+    AABVH<uint> bvh(blobs);
+    
+    std::atomic<bool> found(false);
+    std::atomic<bool> degenerate_hit(false);
+    
+    // a degenerate test only counts as a crossing if it stays one (or
+    // stays degenerate) with the positions moved a little, as in the
+    // retries of the intersection search.  Neighbors on a surface of
+    // revolution, say, can line up exactly without touching
+    auto stillCrosses = [&](const Empty3d::TriEdgeIn &input) -> bool {
+        double quantum = Quantization::quantizedInt2double(1);
+        auto perturb = [&](Vec3d &p) {
+            for(uint j=0; j<3; j++)
+                p.v[j] += Quantization::quantize(quantum *
+                            drand(-SELF_ISCT_PERTURB, SELF_ISCT_PERTURB));
+        };
+        for(int attempt=0; attempt<SELF_ISCT_TRYS; attempt++) {
+            Empty3d::TriEdgeIn moved = input;
+            for(uint k=0; k<3; k++)
+                perturb(moved.tri.p[k]);
+            for(uint k=0; k<2; k++)
+                perturb(moved.edge.p[k]);
+            int degeneracies = Empty3d::degeneracy_count;
+            if(Empty3d::emptyExact(moved) &&
+               Empty3d::degeneracy_count == degeneracies)
+                return false;
+        }
+        return true;
+    };
+    
+    // does an edge of triangle e pass through triangle t?  Edges
+    // meeting t at a shared vertex trivially do so there, and are not
+    // tested.  Vertices count as shared by position, not just by index,
+    // as meshes stored with their vertices repeated along seams (the
+    // primitives are) only touch there
+    auto atCorner = [&](const Vec3d &p, const Tri &t) -> bool {
+        return p == qpos[t.a] || p == qpos[t.b] || p == qpos[t.c];
+    };
+    auto edgesCross = [&](const Tri &e, uint tid) -> bool {
+        const Tri &t = tris[tid];
+        Empty3d::TriEdgeIn input;
+        for(uint k=0; k<3; k++)
+            input.tri.p[k] = qpos[t.v[k]];
+        for(uint k=0; k<3; k++) {
+            const Vec3d &p0 = qpos[e.v[k]];
+            const Vec3d &p1 = qpos[e.v[(k+1)%3]];
+            if(atCorner(p0, t) || atCorner(p1, t))
+                continue;
+            input.edge.p[0] = p0;
+            input.edge.p[1] = p1;
+            BBox3d ebox(min(input.edge.p[0], input.edge.p[1]),
+                        max(input.edge.p[0], input.edge.p[1]));
+            if(!hasIsct(ebox, blobs[tid].bbox))
+                continue;
+            int degeneracies = Empty3d::degeneracy_count;
+            if(!Empty3d::emptyExact(input))
+                return true;
+            if(Empty3d::degeneracy_count != degeneracies &&
+               stillCrosses(input)) {
+                degenerate_hit = true;
+                return true;
+            }
+        }
+        return false;
+    };
+    
+    // each pair of triangles is tested once, from the lower id
+    uint nchunks = (tris.size() + SELF_ISCT_CHUNK - 1) / SELF_ISCT_CHUNK;
+    parallel_for(nchunks, threads, [&](uint chunk) {
+        Quantization::callibrate(maxMag);   // for this thread
+        uint end = std::min(uint(tris.size()), (chunk+1) * SELF_ISCT_CHUNK);
+        for(uint tid = chunk * SELF_ISCT_CHUNK; tid < end && !found; tid++) {
+            const Tri &tri = tris[tid];
+            bvh.for_each_in_box(blobs[tid].bbox, [&](uint other) {
+                if(other <= tid || found)   return;
+                if(edgesCross(tri, other) || edgesCross(tris[other], tid))
+                    found = true;
+            });
+        }
+    });
+    if(degenerate)  *degenerate = degenerate_hit;
+    return found;
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::checkSolid(
+    uint threads, bool *closed, bool *self_intersecting, bool *degenerate
+) {
+    // closedness is one sort; it runs on a thread of its own while
+    // the rest search for intersections
+    std::thread closed_check([&]() {
+        *closed = isClosed();
+    });
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    *self_intersecting = isSelfIntersecting(std::max(1u, threads - 1),
+                                            degenerate);
+    closed_check.join();
+}
+
+
+// where does the ray enter the box?  0 if it starts inside,
+// DBL_MAX if it never does
+inline double queryRayEntry(const Ray3d &ray, const BBox3d &box)
+{
+    double tmin = 0.0;
+    double tmax = DBL_MAX;
+    for(uint k=0; k<3; k++) {
+        if(ray.r[k] == 0.0) {
+            if(ray.p[k] < box.minp[k] || ray.p[k] > box.maxp[k])
+                return DBL_MAX;
+            continue;
+        }
+        double t0 = (box.minp[k] - ray.p[k]) / ray.r[k];
+        double t1 = (box.maxp[k] - ray.p[k]) / ray.r[k];
+        if(t0 > t1)     std::swap(t0, t1);
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+        if(tmin > tmax)
+            return DBL_MAX;
+    }
+    return tmin;
+}
+
+// squared distance from p to the nearest point of the box
+inline double queryBoxDist2(const Vec3d &p, const BBox3d &box)
+{
+    Vec3d zero(0.0, 0.0, 0.0);
+    return len2(max(box.minp - p, max(p - box.maxp, zero)));
+}
+
+inline Vec3d closestPointOnSegment(
+    const Vec3d &p, const Vec3d &a, const Vec3d &b
+) {
+    Vec3d ab = b - a;
+    double l2 = len2(ab);
+    if(l2 == 0.0)   return a;
+    double t = std::min(1.0, std::max(0.0, dot(p - a, ab) / l2));
+    return a + t * ab;
+}
+
+// Works out which feature of the triangle (corner, edge or face) is
+// nearest p from the signs of a few dot products, and projects onto it
+inline Vec3d closestPointOnTriangle(
+    const Vec3d &p, const Vec3d &a, const Vec3d &b, const Vec3d &c
+) {
+    Vec3d ab = b - a;
+    Vec3d ac = c - a;
+    double d1 = dot(ab, p - a);
+    double d2 = dot(ac, p - a);
+    if(d1 <= 0.0 && d2 <= 0.0)                  return a;
+    double d3 = dot(ab, p - b);
+    double d4 = dot(ac, p - b);
+    if(d3 >= 0.0 && d4 <= d3)                   return b;
+    double d5 = dot(ab, p - c);
+    double d6 = dot(ac, p - c);
+    if(d6 >= 0.0 && d5 <= d6)                   return c;
+    
+    double vc = d1*d4 - d3*d2;
+    double vb = d5*d2 - d1*d6;
+    double va = d3*d6 - d5*d4;
+    if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+        return a + (d1 / (d1 - d3)) * ab;
+    if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+        return a + (d2 / (d2 - d6)) * ac;
+    if(va <= 0.0 && d4 >= d3 && d5 >= d6)
+        return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+    
+    double sum = va + vb + vc;
+    if(sum <= 0.0) { // degenerate triangle: the nearest edge will do
+        Vec3d best = closestPointOnSegment(p, a, b);
+        for(Vec3d q : { closestPointOnSegment(p, b, c),
+                        closestPointOnSegment(p, c, a) }) {
+            if(len2(q - p) < len2(best - p))
+                best = q;
+        }
+        return best;
+    }
+    return a + (vb / sum) * ab + (vc / sum) * ac;
+}
+
+
+// Ray directions to count windings along.  A point is tried along the
+// next one whenever the ray grazes an edge or corner, where it might
+// be counted twice or not at all; none lies in a plane that a model
+// built from primitives is likely to have faces in
+static const double QUERY_DIRECTIONS[][3] = {
+    {  0.8637,  0.3541,  0.3583 },
+    { -0.3217,  0.8893,  0.3251 },
+    {  0.2867, -0.4161,  0.8631 },
+    { -0.6121, -0.5407, -0.5771 },
+};
+const uint QUERY_NDIRECTIONS = 4;
+// a ray passing closer to an edge than this (in barycentric terms)
+// grazes it
+const double QUERY_GRAZE = 1.0e-9;
+// batched queries are handed out to the threads in runs of this many
+const uint QUERY_CHUNK = 64;
+
+template<class Func>
+inline void queryBatch(uint n, uint threads, Func query)
+{
+    uint nchunks = (n + QUERY_CHUNK - 1) / QUERY_CHUNK;
+    parallel_for(nchunks, threads, [&](uint chunk) {
+        uint end = std::min(n, (chunk+1) * QUERY_CHUNK);
+        for(uint k = chunk * QUERY_CHUNK; k < end; k++)
+            query(k);
+    });
+}
+
+
+template<class VertData, class TriData>
+Mesh<VertData,TriData>::Query::Query(const Mesh &mesh) :
+    qtris(mesh.tris.size()), bvh(nullptr)
+{
+    std::vector< GeomBlob<uint> > blobs(mesh.tris.size());
+    for(uint tid=0; tid<mesh.tris.size(); tid++) {
+        const Tri &tri = mesh.tris[tid];
+        QTri &qtri = qtris[tid];
+        uint   a = tri.a;
+        uint   b = tri.b;
+        uint   c = tri.c;
+        Vec3d va = mesh.verts[a].pos;
+        Vec3d vb = mesh.verts[b].pos;
+        Vec3d vc = mesh.verts[c].pos;
+        qtri.normal = cross(vb - va, vc - va);
+        // normalize vertex order (to prevent leaks)
+        if(a > b) { std::swap(a, b); std::swap(va, vb); }
+        if(b > c) { std::swap(b, c); std::swap(vb, vc); }
+        if(a > b) { std::swap(a, b); std::swap(va, vb); }
+        qtri.p[0] = va;
+        qtri.p[1] = vb;
+        qtri.p[2] = vc;
+        blobs[tid] = blob(tid);
+    }
+    if(!blobs.empty())
+        bvh = new AABVH<uint>(blobs);
+}
+
+template<class VertData, class TriData>
+GeomBlob<uint> Mesh<VertData,TriData>::Query::blob(uint tid) const
+{
+    const QTri &qtri = qtris[tid];
+    GeomBlob<uint> blob;
+    blob.bbox   = BBox3d(min(qtri.p[0], min(qtri.p[1], qtri.p[2])),
+                         max(qtri.p[0], max(qtri.p[1], qtri.p[2])));
+    blob.point  = (blob.bbox.minp + blob.bbox.maxp) / 2.0;
+    blob.id     = tid;
+    return blob;
+}
+
+template<class VertData, class TriData>
+Mesh<VertData,TriData>::Query::~Query()
+{
+    delete bvh;
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::Query::transform(
+    const double *mat, const Vec3d &offset
+) {
+    Vec3d rows[3] = { Vec3d(mat[0], mat[1], mat[2]),
+                      Vec3d(mat[3], mat[4], mat[5]),
+                      Vec3d(mat[6], mat[7], mat[8]) };
+    // the normals are cross products of edges, and so move by the
+    // cofactor matrix: cross(M a, M b) = cof(M) cross(a, b)
+    Vec3d cofs[3] = { cross(rows[1], rows[2]),
+                      cross(rows[2], rows[0]),
+                      cross(rows[0], rows[1]) };
+    std::vector< GeomBlob<uint> > blobs(qtris.size());
+    for(uint tid=0; tid<qtris.size(); tid++) {
+        QTri &qtri = qtris[tid];
+        for(uint k=0; k<3; k++) {
+            Vec3d p = qtri.p[k];
+            qtri.p[k] = Vec3d(dot(rows[0], p), dot(rows[1], p),
+                              dot(rows[2], p)) + offset;
+        }
+        Vec3d n = qtri.normal;
+        qtri.normal = Vec3d(dot(cofs[0], n), dot(cofs[1], n),
+                            dot(cofs[2], n));
+        blobs[tid] = blob(tid);
+    }
+    if(bvh)
+        bvh->refit(blobs);
+}
+
+template<class VertData, class TriData>
+bool Mesh<VertData,TriData>::Query::contains(const Vec3d &p) const
+{
+    if(!bvh)
+        return false;
+    
+    int winding = 0;
+    for(uint dir=0; dir<QUERY_NDIRECTIONS; dir++) {
+        Ray3d ray(p, Vec3d(QUERY_DIRECTIONS[dir][0],
+                           QUERY_DIRECTIONS[dir][1],
+                           QUERY_DIRECTIONS[dir][2]));
+        bool grazed = false;
+        winding = 0;
+        // every crossing along the ray counts, so nothing is pruned,
+        // except that a graze gives up on this ray at once
+        bvh->nearest_first([&](const BBox3d &box) {
+            return queryRayEntry(ray, box);
+        }, [&](uint tid) -> double {
+            const QTri &qtri = qtris[tid];
+            double t;
+            Vec3d  bary;
+            if(isct_ray_triangle(ray, qtri.p[0], qtri.p[1], qtri.p[2],
+                                 &t, &bary)) {
+                if(min(bary) < QUERY_GRAZE)
+                    grazed = true;
+                winding += (dot(qtri.normal, ray.r) > 0.0)? 1 : -1;
+            }
+            return (grazed)? 0.0 : DBL_MAX;
+        });
+        if(!grazed)
+            break;
+    }
+    return winding > 0;
+}
+
+template<class VertData, class TriData>
+typename Mesh<VertData,TriData>::Isct
+    Mesh<VertData,TriData>::Query::pick(const Ray3d &ray) const
+{
+    Isct result;
+    result.ray = ray;
+    result.exists = false;
+    if(!bvh)
+        return result;
+    
+    double mint = DBL_MAX;
+    bvh->nearest_first([&](const BBox3d &box) {
+        return queryRayEntry(ray, box);
+    }, [&](uint tid) -> double {
+        const QTri &qtri = qtris[tid];
+        double t;
+        Vec3d  bary;
+        if(isct_ray_triangle(ray, qtri.p[0], qtri.p[1], qtri.p[2],
+                             &t, &bary) && t < mint) {
+            result.exists = true;
+            mint = t;
+            result.tri_id = tid;
+            result.isct = ray.p + t * ray.r;
+            result.bary = bary;
+        }
+        return mint;
+    });
+    return result;
+}
+
+template<class VertData, class TriData>
+Vec3d Mesh<VertData,TriData>::Query::closestPoint(
+    const Vec3d &p, uint *tri_id
+) const {
+    if(!bvh)
+        return p;
+    
+    Vec3d  closest = p;
+    double mind2 = DBL_MAX;
+    bvh->nearest_first([&](const BBox3d &box) {
+        return queryBoxDist2(p, box);
+    }, [&](uint tid) -> double {
+        const QTri &qtri = qtris[tid];
+        Vec3d q = closestPointOnTriangle(p, qtri.p[0], qtri.p[1], qtri.p[2]);
+        double d2 = len2(q - p);
+        if(d2 < mind2) {
+            mind2 = d2;
+            closest = q;
+            if(tri_id)  *tri_id = tid;
+        }
+        return mind2;
+    });
+    return closest;
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::Query::contains(
+    const std::vector<Vec3d> &ps, std::vector<char> *inside, uint threads
+) const {
+    inside->resize(ps.size());
+    queryBatch(ps.size(), threads, [&](uint k) {
+        (*inside)[k] = contains(ps[k]);
+    });
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::Query::pick(
+    const std::vector<Ray3d> &rays, std::vector<Isct> *iscts, uint threads
+) const {
+    iscts->resize(rays.size());
+    queryBatch(rays.size(), threads, [&](uint k) {
+        (*iscts)[k] = pick(rays[k]);
+    });
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::Query::closestPoint(
+    const std::vector<Vec3d> &ps, std::vector<Vec3d> *closest, uint threads
+) const {
+    closest->resize(ps.size());
+    queryBatch(ps.size(), threads, [&](uint k) {
+        (*closest)[k] = closestPoint(ps[k]);
+    });
+}
@@ -26,9 +26,9 @@
 #pragma once
 
 #include <map>
-#include <set>
 
 #include "memPool.h"
+#include "indexedHeap.h"
 
 //#include "files.h"
 
@@ -45,15 +45,76 @@ enum EdgeRemeshOperation {
 struct RemeshEdgeAuxiliary {
     double                  score;      // priority for queue
     EdgeRemeshOperation     op;         // operation to perform
+    uint                    heap_idx;   // position in the queue
 };
 
+struct RemeshQueueSlot {
+    inline uint& operator()(Eptr e) const {
+        return reinterpret_cast<RemeshEdgeAuxiliary*>(e->data)->heap_idx;
+    }
+};
+typedef IndexedHeap<Eptr, RemeshQueueSlot> RemeshQueue;
+
+// Quadric error metric (Garland & Heckbert) used by simplify().
+// Stores the symmetric 4x4 matrix sum of (n,d)(n,d)^T over the planes
+// n.x + d = 0 accumulated so far; eval(p) is the sum of squared
+// distances from p to those planes.
+struct ErrorQuadric {
+    double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    
+    inline void zero() {
+        xx = xy = xz = xw = yy = yz = yw = zz = zw = ww = 0.0;
+    }
+    inline void addPlane(const Vec3d &n, double d) {
+        xx += n.x*n.x;  xy += n.x*n.y;  xz += n.x*n.z;  xw += n.x*d;
+                        yy += n.y*n.y;  yz += n.y*n.z;  yw += n.y*d;
+                                        zz += n.z*n.z;  zw += n.z*d;
+                                                        ww += d*d;
+    }
+    inline void add(const ErrorQuadric &q) {
+        xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+        yy += q.yy; yz += q.yz; yw += q.yw;
+        zz += q.zz; zw += q.zw;
+        ww += q.ww;
+    }
+    inline double eval(const Vec3d &p) const {
+        return      xx*p.x*p.x + 2.0*xy*p.x*p.y + 2.0*xz*p.x*p.z
+                  + yy*p.y*p.y + 2.0*yz*p.y*p.z
+                  + zz*p.z*p.z
+                  + 2.0*(xw*p.x + yw*p.y + zw*p.z)
+                  + ww;
+    }
+};
+
+inline ErrorQuadric& quadric(Vptr v) {
+    return *reinterpret_cast<ErrorQuadric*>(v->data);
+}
+
 template<class VertData, class TriData>
 struct Mesh<VertData, TriData>::RemeshScratchpad {
     TopoCache                               cache;
     MemPool<RemeshEdgeAuxiliary>            edge_data;
-    std::set< std::pair<double, Eptr> >     queue;
+    RemeshQueue                             queue;
+    
+    // simplify() and cleanSlivers() only:
+    // collapses are scored by quadric error instead
+    bool                                    simplifying;
+    double                                  max_error;
+    double                                  sliver_angle; // 0 = simplify
+    MemPool<ErrorQuadric>                   quadrics;
+    Vec3d                                   collapse_pos;
+    
+    RemeshScratchpad(Mesh<VertData, TriData> *mesh) :
+        cache(mesh), simplifying(false), max_error(0.0), sliver_angle(0.0)
+    {}
     
-    RemeshScratchpad(Mesh<VertData, TriData> *mesh) : cache(mesh) {}
+    inline RemeshEdgeAuxiliary* newEdgeData() {
+        RemeshEdgeAuxiliary *aux = edge_data.alloc();
+        aux->score      = -1.0;
+        aux->op         = EDGE_NOTHING;
+        aux->heap_idx   = RemeshQueue::NOT_IN_HEAP;
+        return aux;
+    }
 };
 
 
@@ -95,20 +156,47 @@ void Mesh<VertData, TriData>::remesh()
     
     // Then, we set up the priority queue
     // (allocating auxiliary data as we go)
+    scratchpad.queue.reserve(scratchpad.cache.edges.size());
     scratchpad.cache.edges.for_each([this, &scratchpad](Eptr edge) {
-        edge->data = scratchpad.edge_data.alloc();
-        scoreAndEnqueue(scratchpad.queue, edge);
+        edge->data = scratchpad.newEdgeData();
+        scoreAndEnqueue(scratchpad, edge);
     });
     
-    int cutoff = 10000;
+    runRemeshQueue(scratchpad);
+    
+    //std::cout << " cache.tris is "
+    //          << scratchpad.cache.tris.size() << std::endl;
+    //std::cout << "prefinalize tri count: " << tris.size() << std::endl;
+    
+    // finally, we commit all of the results of this remeshing operation
+    // causing the data storage to defrag and clean out dead items
+    scratchpad.cache.commit();
+    
+    //std::cout << "remesh final tri count: " << tris.size() << std::endl;
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData, TriData>::runRemeshQueue(RemeshScratchpad &scratchpad)
+{
+    // work out the budget for this run
+    uint max_ops = remesh_options.maxOperations;
+    if(max_ops == 0)
+        max_ops = 10 * scratchpad.cache.edges.size();
+    double max_ms = remesh_options.maxSeconds * 1000.0;
+    Timer timer;
+    
+    uint n_ops = 0;
     // now let's go into a loop pulling work off of the queue
-    while(scratchpad.queue.size() > 0) {
-        // pop the end of the queue
-        auto        it_top          = scratchpad.queue.end();
-                    it_top--;
-        //double      top_score       = it_top->first;
-        Eptr        top_edge        = it_top->second;
-                    scratchpad.queue.erase(it_top);
+    while(!scratchpad.queue.empty()) {
+        // pop the highest priority edge
+        Eptr        top_edge        = scratchpad.queue.pop();
+        
+        // the neighborhood may have moved since this edge was scored,
+        // so re-validate collapses before committing to them
+        if(scratchpad.simplifying &&
+           computeCollapseScore(scratchpad, top_edge,
+                                &scratchpad.collapse_pos) <= 0.0)
+            continue;
         
         // Which operation should be performed to this edge?
         EdgeRemeshOperation         op =
@@ -120,44 +208,38 @@ void Mesh<VertData, TriData>::remesh()
                     //std::cout << "edge collapse" << std::endl;
                     edgeCollapse(scratchpad, top_edge, true);
         } // else do nothing (should have score <= 0.0 then...)
-        cutoff--;
-        if(cutoff < 0)
+        n_ops++;
+        if(n_ops >= max_ops)
+            break;
+        // checking the clock is not free, so only do it periodically
+        if(max_ms > 0.0 && (n_ops & 63) == 0 && timer.lap() > max_ms)
             break;
     }
-    
-    //std::cout << " cache.tris is "
-    //          << scratchpad.cache.tris.size() << std::endl;
-    //std::cout << "prefinalize tri count: " << tris.size() << std::endl;
-    
-    // finally, we commit all of the results of this remeshing operation
-    // causing the data storage to defrag and clean out dead items
-    scratchpad.cache.commit();
-    
-    //std::cout << "remesh final tri count: " << tris.size() << std::endl;
 }
 
 
 
+// (re-)scores the edge, moving it within the queue if it is already there
 template<class VertData, class TriData>
 void Mesh<VertData, TriData>::scoreAndEnqueue(
-    std::set< std::pair<double, Eptr> >     &queue,
-    Eptr                                     edge
+    RemeshScratchpad    &scratchpad,
+    Eptr                 edge
 ) {
-    double score = computeEdgeScore(edge);
+    double score = (scratchpad.simplifying)?
+                        computeCollapseScore(scratchpad, edge) :
+                        computeEdgeScore(edge);
     if(score > 0.0) // only enqueue edges with actual work to do
-        queue.insert(std::make_pair(score, edge));
+        scratchpad.queue.update(edge, score);
+    else
+        scratchpad.queue.remove(edge);
 }
 
 template<class VertData, class TriData>
 void Mesh<VertData, TriData>::dequeue(
-    std::set< std::pair<double, Eptr> >     &queue,
-    Eptr                                     edge
+    RemeshScratchpad    &scratchpad,
+    Eptr                 edge
 ) {
-    double score =
-            reinterpret_cast<RemeshEdgeAuxiliary*>(edge->data)->score;
-    auto it = queue.find(std::make_pair(score, edge));
-    if(it != queue.end())
-        queue.erase(it);
+    scratchpad.queue.remove(edge);
 }
 
 
@@ -300,7 +382,7 @@ Eptr Mesh<VertData, TriData>::allocateRemeshEdge(
     RemeshScratchpad &scratchpad
 ) {
     Eptr        e           = scratchpad.cache.newEdge();
-                e->data     = scratchpad.edge_data.alloc();
+                e->data     = scratchpad.newEdgeData();
     return      e;
 }
 
@@ -309,7 +391,7 @@ void Mesh<VertData, TriData>::deallocateRemeshEdge(
     RemeshScratchpad &scratchpad,
     Eptr e
 ) {
-                dequeue(scratchpad.queue, e);
+                dequeue(scratchpad, e);
                 scratchpad.cache.freeEdge(e);
 }
 
@@ -712,6 +794,14 @@ void Mesh<VertData, TriData>::edgeCollapse(
         const VertData      &data0              = verts[v0->ref];
         const VertData      &data1              = verts[v1->ref];
                             data_new.merge(data0, data1);
+        if(scratchpad.simplifying) {
+            ErrorQuadric    *q                  =
+                                        scratchpad.quadrics.alloc();
+                            *q                  = quadric(v0);
+                            q->add(quadric(v1));
+                            v_merged->data      = q;
+                            data_new.pos        = scratchpad.collapse_pos;
+        }
     }
     // merge triangles' data
     for(uint i=0; i<tri_wedges.size(); i++) {
@@ -903,15 +993,15 @@ void Mesh<VertData, TriData>::edgeCollapse(
     // adjust priorities for edges which might have been effected by this op.
     // Only explicitly dequeue pre-existing edges we did not delete!
     for(Eptr e : edges_merged) { if(e) { // might be deleted
-                            scoreAndEnqueue(scratchpad.queue, e);
+                            scoreAndEnqueue(scratchpad, e);
     }}
     for(Eptr e : edges_moved) { // def. not deleted
-                            scoreAndEnqueue(scratchpad.queue, e);
+                            scoreAndEnqueue(scratchpad, e);
     }
     for(Eptr e : borderEdges) {
             // border edges could have been deleted...
-                            dequeue(scratchpad.queue, e);
-                            scoreAndEnqueue(scratchpad.queue, e);
+                            dequeue(scratchpad, e);
+                            scoreAndEnqueue(scratchpad, e);
     }
     
     // that should more or less complete an edge collapse
@@ -1196,14 +1286,236 @@ void Mesh<VertData,TriData>::edgeSplit(
     
     // recompute edge scores for all edges whose scores might be effected
     // Don't need to dequeue newly created edges...
-                            scoreAndEnqueue(scratchpad.queue, e0_new);
-                            scoreAndEnqueue(scratchpad.queue, e1_new);
+                            scoreAndEnqueue(scratchpad, e0_new);
+                            scoreAndEnqueue(scratchpad, e1_new);
     for(Eptr e : es_mid) {
-                            scoreAndEnqueue(scratchpad.queue, e);
+                            scoreAndEnqueue(scratchpad, e);
     }
     for(Eptr e : borderEdges) {
-                            dequeue(scratchpad.queue, e);
-                            scoreAndEnqueue(scratchpad.queue, e);
+                            dequeue(scratchpad, e);
+                            scoreAndEnqueue(scratchpad, e);
+    }
+}
+
+
+
+template<class VertData, class TriData>
+void Mesh<VertData, TriData>::simplify(double tolerance)
+{
+    if(verts.size() == 0)   return; // pathology guard
+    
+    weldVertices();
+    RemeshScratchpad scratchpad(this);
+    scratchpad.max_error    = tolerance * tolerance;
+    runCollapses(scratchpad);
+}
+
+template<class VertData, class TriData>
+uint Mesh<VertData, TriData>::cleanSlivers(double min_angle)
+{
+    if(verts.size() == 0 || min_angle <= 0.0)   return 0;
+    
+    uint n_tris = tris.size();
+    RemeshScratchpad scratchpad(this);
+    scratchpad.sliver_angle = min_angle;
+    runCollapses(scratchpad);
+    return n_tris - tris.size();
+}
+
+template<class VertData, class TriData>
+void Mesh<VertData, TriData>::runCollapses(RemeshScratchpad &scratchpad)
+{
+    scratchpad.simplifying  = true;
+    
+    // compute which vertices are boundary or not
+    for(VertData &v : verts) {
+        v.manifold = true;
+    }
+    scratchpad.cache.edges.for_each([this, &scratchpad](Eptr edge) {
+        if(edge->tris.size() != 2) {
+            verts[edge->verts[0]->ref].manifold = false;
+            verts[edge->verts[1]->ref].manifold = false;
+        }
+    });
+    
+    // every vertex starts with the planes of its incident triangles
+    scratchpad.cache.verts.for_each([&scratchpad](Vptr v) {
+        ErrorQuadric *q = scratchpad.quadrics.alloc();
+        q->zero();
+        v->data = q;
+    });
+    scratchpad.cache.tris.for_each([this](Tptr t) {
+        const Vec3d &p0 = verts[t->verts[0]->ref].pos;
+        const Vec3d &p1 = verts[t->verts[1]->ref].pos;
+        const Vec3d &p2 = verts[t->verts[2]->ref].pos;
+        Vec3d n = cross(p1 - p0, p2 - p0);
+        double n_len = len(n);
+        if(n_len == 0.0)    return; // degenerate triangles add nothing
+        n /= n_len;
+        double d = -dot(n, p0);
+        for(uint k=0; k<3; k++)
+            quadric(t->verts[k]).addPlane(n, d);
+    });
+    
+    scratchpad.queue.reserve(scratchpad.cache.edges.size());
+    scratchpad.cache.edges.for_each([this, &scratchpad](Eptr edge) {
+        edge->data = scratchpad.newEdgeData();
+        scoreAndEnqueue(scratchpad, edge);
+    });
+    
+    runRemeshQueue(scratchpad);
+    
+    scratchpad.cache.commit();
+}
+
+// would moving the vertex v (an endpoint of e) to p flip or
+// flatten any triangle incident to v but not to e?
+template<class VertData, class TriData>
+bool Mesh<VertData, TriData>::collapseFlipsTris(
+    Eptr e, Vptr v, const Vec3d &p
+) {
+    for(Tptr t : v->tris) {
+        if(t->edges[0] == e || t->edges[1] == e || t->edges[2] == e)
+            continue;
+        Vec3d old_pos[3];
+        Vec3d new_pos[3];
+        for(uint k=0; k<3; k++) {
+            old_pos[k] = new_pos[k] = verts[t->verts[k]->ref].pos;
+            if(t->verts[k] == v)    new_pos[k] = p;
+        }
+        Vec3d n_old = cross(old_pos[1] - old_pos[0], old_pos[2] - old_pos[0]);
+        Vec3d n_new = cross(new_pos[1] - new_pos[0], new_pos[2] - new_pos[0]);
+        double l_old = len(n_old);
+        double l_new = len(n_new);
+        if(l_new == 0.0)    return true;    // would become degenerate
+        if(l_old == 0.0)    continue;       // no facing to preserve
+        // require the normal to stay within ~60 degrees of where it was
+        if(dot(n_old, n_new) <= 0.5 * l_old * l_new)
+            return true;
     }
+    return false;
 }
 
+// is this edge the shortest edge of a triangle with an angle
+// below min_angle (in degrees)?
+template<class VertData, class TriData>
+bool Mesh<VertData, TriData>::isSliverEdge(Eptr edge, double min_angle)
+{
+    double cos_max = cos(deg2rad(min_angle));
+    for(Tptr t : edge->tris) {
+        Vec3d p[3];
+        for(uint k=0; k<3; k++)
+            p[k] = verts[t->verts[k]->ref].pos;
+        // edge k is opposite vertex k
+        uint   shortest     = 0;
+        double shortest_len = DBL_MAX;
+        bool   sliver       = false;
+        for(uint k=0; k<3; k++) {
+            Vec3d  e0 = p[(k+1)%3] - p[k];
+            Vec3d  e1 = p[(k+2)%3] - p[k];
+            double l0 = len(e0);
+            double l1 = len(e1);
+            if(l0 == 0.0 || l1 == 0.0 || dot(e0, e1) > cos_max * l0 * l1)
+                sliver = true;
+            double l_opp = len(p[(k+2)%3] - p[(k+1)%3]);
+            if(l_opp < shortest_len) {
+                shortest_len = l_opp;
+                shortest = k;
+            }
+        }
+        if(sliver && t->edges[shortest] == edge)
+            return true;
+    }
+    return false;
+}
+
+// Score for collapsing this edge during simplify():
+//      max_error - (quadric error of the collapsed vertex)
+// so the cheapest collapse has the highest priority.
+// During cleanSlivers() only the shortest edges of slivers qualify,
+// and each may move the surface by at most half its own length.
+// Collapses that would change the topology or fold the surface
+// are scored -1.0
+template<class VertData, class TriData>
+double Mesh<VertData, TriData>::computeCollapseScore(
+    RemeshScratchpad &scratchpad, Eptr edge, Vec3d *placement
+) {
+    RemeshEdgeAuxiliary *edge_aux =
+                reinterpret_cast<RemeshEdgeAuxiliary*>(edge->data);
+    edge_aux->score = -1.0;
+    edge_aux->op    = EDGE_NOTHING;
+    
+    // only collapse interior edges of a manifold patch
+    if(edge->tris.size() != 2)
+        return edge_aux->score;
+    Vptr v0 = edge->verts[0];
+    Vptr v1 = edge->verts[1];
+    
+    // link condition: the endpoints may only share the two opposite
+    // vertices as neighbors, or else the collapse pinches the surface.
+    // The opposite vertices also have to keep a valence of at least 3
+    uint n_shared = 0;
+    for(Eptr e0 : v0->edges) {
+        Vptr n0 = (e0->verts[0] == v0)? e0->verts[1] : e0->verts[0];
+        for(Eptr e1 : v1->edges) {
+            Vptr n1 = (e1->verts[0] == v1)? e1->verts[1] : e1->verts[0];
+            if(n0 == n1) {
+                n_shared++;
+                if(n0->edges.size() <= 3)
+                    return edge_aux->score;
+            }
+        }
+    }
+    if(n_shared != 2)
+        return edge_aux->score;
+    
+    double max_error = scratchpad.max_error;
+    if(scratchpad.sliver_angle > 0.0) {
+        if(!isSliverEdge(edge, scratchpad.sliver_angle))
+            return edge_aux->score;
+        double l = len(verts[v1->ref].pos - verts[v0->ref].pos);
+        max_error = 0.25 * l * l;
+    }
+    
+    ErrorQuadric q = quadric(v0);
+    q.add(quadric(v1));
+    
+    // leave non-manifold vertices (e.g. the seam where the two shells
+    // of an XOR meet) and everything touching them alone; moving the
+    // neighborhood of a seam easily makes the shells collide
+    const VertData &data0 = verts[v0->ref];
+    const VertData &data1 = verts[v1->ref];
+    if(!data0.manifold || !data1.manifold)
+        return edge_aux->score;
+    Vec3d candidates[3] = {
+        (data0.pos + data1.pos) / 2.0, data0.pos, data1.pos
+    };
+    
+    double best_error = 0.0;
+    bool   found      = false;
+    for(const Vec3d &p : candidates) {
+        // rounding can push the error of a perfectly flat patch
+        // slightly below zero, which still means a free collapse
+        double error = std::max(q.eval(p), 0.0);
+        if(error > max_error)               continue;
+        if(found && error >= best_error)    continue;
+        if(collapseFlipsTris(edge, v0, p) || collapseFlipsTris(edge, v1, p))
+            continue;
+        best_error = error;
+        found      = true;
+        if(placement)   *placement = p;
+    }
+    if(!found)
+        return edge_aux->score;
+    
+    if(scratchpad.sliver_angle > 0.0) {
+        // any valid sliver collapse is worth doing; even
+        // zero length edges (max_error == 0) must get a positive score
+        edge_aux->score = (max_error > 0.0)?
+                            2.0 - best_error / max_error : 2.0;
+    } else {
+        edge_aux->score = max_error - best_error;
+    }
+    edge_aux->op    = EDGE_COLLAPSE;
+    return edge_aux->score;
+}
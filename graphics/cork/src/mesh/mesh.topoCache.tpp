@@ -302,6 +302,7 @@ void Mesh<VertData, TriData>::TopoCache::init()
 template<class VertData, class TriData>
 void Mesh<VertData, TriData>::TopoCache::commit()
 {
+    mesh->convexity = CONVEXITY_UNKNOWN;
     //ENSURE(isValid());
     
     // record which vertices are live
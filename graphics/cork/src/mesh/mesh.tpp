@@ -35,14 +35,15 @@
 
 // constructors
 template<class VertData, class TriData>
-Mesh<VertData,TriData>::Mesh() {}
+Mesh<VertData,TriData>::Mesh() : convexity(CONVEXITY_UNKNOWN) {}
 template<class VertData, class TriData>
 Mesh<VertData,TriData>::Mesh(Mesh &&cp)
-    : tris(cp.tris), verts(cp.verts)
+    : tris(cp.tris), verts(cp.verts), convexity(cp.convexity)
 {}
 template<class VertData, class TriData>
 Mesh<VertData,TriData>::Mesh(const RawMesh<VertData,TriData> &raw) :
-    tris(raw.triangles.size()), verts(raw.vertices)
+    tris(raw.triangles.size()), verts(raw.vertices),
+    convexity(CONVEXITY_UNKNOWN)
 {
     // fill out the triangles
     for(uint i=0; i<raw.triangles.size(); i++) {
@@ -60,6 +61,7 @@ void Mesh<VertData,TriData>::operator=(Mesh &&src)
 {
     tris = src.tris;
     verts = src.verts;
+    convexity = src.convexity;
 }
 
 template<class VertData, class TriData>
@@ -117,6 +119,7 @@ void Mesh<VertData,TriData>::disjointUnion(const Mesh &cp)
     uint cpVsize  = cp.verts.size();
     uint cpTsize  = cp.tris.size();
     uint newVsize = oldVsize + cpVsize;
+    convexity = CONVEXITY_UNKNOWN;
     uint newTsize = oldTsize + cpTsize;
     
     std::vector<int> v_remap(cpVsize); // oh this is obvious...
@@ -135,13 +138,75 @@ void Mesh<VertData,TriData>::disjointUnion(const Mesh &cp)
     }
 }
 
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::weldVertices()
+{
+    // Sort the vertex ids by position, ties by id, so that vertices
+    // sharing a position sit together with the lowest id first; that
+    // one then stands for the rest
+    std::vector<uint> order(verts.size());
+    for(uint i=0; i<order.size(); i++)
+        order[i] = i;
+    auto samePos = [this](uint i, uint j) {
+        return verts[i].pos.x == verts[j].pos.x &&
+               verts[i].pos.y == verts[j].pos.y &&
+               verts[i].pos.z == verts[j].pos.z;
+    };
+    std::sort(order.begin(), order.end(), [this](uint i, uint j) {
+        const Vec3d &p = verts[i].pos;
+        const Vec3d &q = verts[j].pos;
+        if(p.x != q.x)  return p.x < q.x;
+        if(p.y != q.y)  return p.y < q.y;
+        if(p.z != q.z)  return p.z < q.z;
+        return i < j;
+    });
+    std::vector<uint> first(verts.size());
+    bool any_welded = false;
+    for(uint k=0; k<order.size(); k++) {
+        if(k > 0 && samePos(order[k-1], order[k])) {
+            first[order[k]] = first[order[k-1]];
+            any_welded = true;
+        } else {
+            first[order[k]] = order[k];
+        }
+    }
+    if(!any_welded)
+        return;
+    
+    // renumber the remaining vertices in their old order
+    std::vector<uint> remap(verts.size());
+    uint nverts = 0;
+    for(uint i=0; i<verts.size(); i++) {
+        if(first[i] == i) {
+            remap[i] = nverts;
+            verts[nverts++] = verts[i];
+        } else {
+            remap[i] = remap[first[i]];
+        }
+    }
+    verts.resize(nverts);
+    
+    // triangles left with a repeated vertex have collapsed
+    uint ntris = 0;
+    for(uint t=0; t<tris.size(); t++) {
+        Tri tri = tris[t];
+        for(uint k=0; k<3; k++)
+            tri.v[k] = remap[tri.v[k]];
+        if(tri.a == tri.b || tri.b == tri.c || tri.c == tri.a)
+            continue;
+        tris[ntris++] = tri;
+    }
+    tris.resize(ntris);
+    convexity = CONVEXITY_UNKNOWN;
+}
+
 
 
 
 
 // Picking.
 // Dumb Implementation just passes over all triangles w/o any precomputed
-// acceleration structure
+// acceleration structure (Mesh::Query keeps one, for repeated picking)
 template<class VertData, class TriData>
 typename Mesh<VertData,TriData>::Isct
     Mesh<VertData,TriData>::pick(Ray3d ray)
@@ -189,29 +254,32 @@ typename Mesh<VertData,TriData>::Isct
 template<class VertData, class TriData>
 bool Mesh<VertData,TriData>::isClosed()
 {
-    EGraphCache<int> chains = createEGraphCache<int>();
-    chains.for_each([&](uint i, uint j, EGraphEntry<int> &entry) {
-        entry.data = 0;
-    });
-    // count up how many times each edge is encountered in one
-    // orientation vs. the other
-    for(Tri &tri : tris) {
-        chains(tri.a, tri.b).data ++;
-        chains(tri.b, tri.a).data --;
-        
-        chains(tri.b, tri.c).data ++;
-        chains(tri.c, tri.b).data --;
-        
-        chains(tri.c, tri.a).data ++;
-        chains(tri.a, tri.c).data --;
+    // Closed means every edge is used as often in one orientation as
+    // in the other.  Key each use by the undirected edge, along with
+    // its direction, and sort; then the uses of each edge sit together,
+    // and can be counted off against each other
+    std::vector< std::pair<uint64_t, bool> > uses;
+    uses.reserve(3 * tris.size());
+    for(const Tri &tri : tris) {
+        for(uint k=0; k<3; k++) {
+            uint64_t a = tri.v[k];
+            uint64_t b = tri.v[(k+1)%3];
+            if(a == b)  continue;
+            uses.push_back((a < b)? std::make_pair(a << 32 | b, false)
+                                  : std::make_pair(b << 32 | a, true));
+        }
     }
-    // now go through and see if any of these are non-zero
-    bool closed = true;
-    chains.for_each([&](uint i, uint j, EGraphEntry<int> &entry) {
-        if(entry.data != 0)
-            closed = false;
-    });
-    return closed;
+    std::sort(uses.begin(), uses.end());
+    
+    for(uint i=0; i<uses.size(); ) {
+        uint64_t edge = uses[i].first;
+        int count = 0;
+        for(; i<uses.size() && uses[i].first == edge; i++)
+            count += (uses[i].second)? -1 : 1;
+        if(count != 0)
+            return false;
+    }
+    return true;
 }
 
 
@@ -293,6 +361,38 @@ std::vector<uint> Mesh<VertData,TriData>::getComponentIds()
     return uf.dump();
 }
 
+template<class VertData, class TriData>
+void Mesh<VertData,TriData>::splitIntoComponents(std::vector<Mesh> &parts)
+{
+    std::vector<uint> vcomps = getComponentIds();
+    
+    // number the components densely
+    std::vector<uint> part_of(verts.size(), uint(-1));
+    uint nparts = 0;
+    for(uint vid=0; vid<verts.size(); vid++) {
+        uint &part = part_of[vcomps[vid]];
+        if(part == uint(-1))
+            part = nparts++;
+    }
+    
+    parts.clear();
+    parts.resize(nparts);
+    std::vector<uint> vremap(verts.size());
+    for(uint vid=0; vid<verts.size(); vid++) {
+        Mesh &part = parts[part_of[vcomps[vid]]];
+        vremap[vid] = part.verts.size();
+        part.verts.push_back(verts[vid]);
+    }
+    for(const Tri &tri : tris) {
+        Mesh &part = parts[part_of[vcomps[tri.a]]];
+        part.tris.push_back(tri);
+        Tri &copy = part.tris.back();
+        copy.a = vremap[tri.a];
+        copy.b = vremap[tri.b];
+        copy.c = vremap[tri.c];
+    }
+}
+
 
 
 
@@ -0,0 +1,302 @@
+// +-------------------------------------------------------------------------
+// | transform.cpp
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+
+// The transforms behind Translate, Rotate, Scale and Reflect; none of
+// this touches the Mesh template, so the benchmark can link it too
+
+#include "cork.h"
+
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CORK_AFFINE_AVX2
+#include <immintrin.h>
+#endif
+
+#define PI 3.14159265
+
+// SHAPESHIFTER
+
+// Multiply a 3x3 matrix and a 3-dim vector
+void matMult3(float *mat, float *vin, float *vout) 
+{
+    vout[0] = mat[0]*vin[0] + mat[1]*vin[1] + mat[2]*vin[2]; 
+    vout[1] = mat[3]*vin[0] + mat[4]*vin[1] + mat[5]*vin[2]; 
+    vout[2] = mat[6]*vin[0] + mat[7]*vin[1] + mat[8]*vin[2]; 
+}
+
+void reflectCork(CorkTriMesh *mesh, float a, float b, float c)
+{
+    float k = 1.0f/(a*a + b*b + c*c); 
+    if (k == 0) 
+        return;
+
+    float refmat[9]; 
+    refmat[0] = k * (-a*a + b*b + c*c); 
+    refmat[1] = k * (-2.0f*a*b); 
+    refmat[2] = k * (-2.0f*a*c);
+    refmat[3] = refmat[1]; 
+    refmat[4] = k * (a*a - b*b + c*c); 
+    refmat[5] = k * (-2.0f*b*c); 
+    refmat[6] = refmat[2]; 
+    refmat[7] = refmat[5];
+    refmat[8] = k * (a*a + b*b - c*c); 
+
+    float ppos[3]; 
+    for (uint i = 0; i < mesh->n_vertices; ++i) {
+        ppos[0] = mesh->vertices[i*3]; 
+        ppos[1] = mesh->vertices[i*3+1];
+        ppos[2] = mesh->vertices[i*3+2];
+        matMult3(refmat, ppos, &(mesh->vertices[i*3])); 
+    } 
+}
+
+void rotateCork(CorkTriMesh *mesh, float x, float y, float z)
+{
+    float cosX = (float)cos(x * PI / 180.0);     
+    float sinX = (float)sin(x * PI / 180.0); 
+    float cosY = (float)cos(y * PI / 180.0);     
+    float sinY = (float)sin(y * PI / 180.0); 
+    float cosZ = (float)cos(z * PI / 180.0);     
+    float sinZ = (float)sin(z * PI / 180.0); 
+
+    float rotx[] = {1, 0, 0, 0, cosX, -sinX, 0, sinX, cosX};
+    float roty[] = {cosY, 0, sinY, 0, 1, 0, -sinY, 0, cosY};
+    float rotz[] = {cosZ, -sinZ, 0, sinZ, cosZ, 0, 0, 0, 1};
+    float ppos[3]; 
+    for (uint i = 0; i < mesh->n_vertices; ++i) {
+        ppos[0] = mesh->vertices[i*3]; 
+        ppos[1] = mesh->vertices[i*3+1];
+        ppos[2] = mesh->vertices[i*3+2];
+        matMult3(rotx, ppos, &(mesh->vertices[i*3]));
+        ppos[0] = mesh->vertices[i*3]; 
+        ppos[1] = mesh->vertices[i*3+1];
+        ppos[2] = mesh->vertices[i*3+2];
+        matMult3(roty, ppos, &(mesh->vertices[i*3]));
+        ppos[0] = mesh->vertices[i*3]; 
+        ppos[1] = mesh->vertices[i*3+1];
+        ppos[2] = mesh->vertices[i*3+2];
+        matMult3(rotz, ppos, &(mesh->vertices[i*3]));
+    } 
+}   
+
+
+void scaleCork(CorkTriMesh *mesh, float x, float y, float z)
+{
+    float scale[] = {x, 0, 0, 0, y, 0, 0, 0, z};
+    float ppos[3]; 
+    for (uint i = 0; i < mesh->n_vertices; ++i) {
+        ppos[0] = mesh->vertices[i*3]; 
+        ppos[1] = mesh->vertices[i*3+1];
+        ppos[2] = mesh->vertices[i*3+2];
+        matMult3(scale, ppos, &(mesh->vertices[i*3])); 
+    } 
+}
+void translateCork(CorkTriMesh *mesh, float x, float y, float z) 
+{
+    for (uint i = 0; i < mesh->n_vertices; ++i) {
+        mesh->vertices[i*3] += x; 
+        mesh->vertices[i*3+1] += y; 
+        mesh->vertices[i*3+2] += z; 
+    }
+}
+
+
+// a linear map (3x3, row major) as an affine one
+static void linearAffine(const double *mat, double *affine)
+{
+    for(uint r=0; r<3; r++) {
+        for(uint c=0; c<3; c++)
+            affine[4*r+c] = mat[3*r+c];
+        affine[4*r+3] = 0.0;
+    }
+}
+
+void reflectAffine(float a, float b, float c, double *affine)
+{
+    double n2 = double(a)*a + double(b)*b + double(c)*c;
+    if(n2 == 0.0) {
+        scaleAffine(1.0f, 1.0f, 1.0f, affine);
+        return;
+    }
+    // I - 2 n n^T / |n|^2
+    double n[3] = { a, b, c };
+    double mat[9];
+    for(uint i=0; i<3; i++)
+        for(uint j=0; j<3; j++)
+            mat[3*i+j] = ((i == j)? 1.0 : 0.0) - 2.0 * n[i] * n[j] / n2;
+    linearAffine(mat, affine);
+}
+
+void rotateAffine(float x, float y, float z, double *affine)
+{
+    // about x first, then y, then z, as rotateCork() does
+    double cosX = cos(x * PI / 180.0);
+    double sinX = sin(x * PI / 180.0);
+    double cosY = cos(y * PI / 180.0);
+    double sinY = sin(y * PI / 180.0);
+    double cosZ = cos(z * PI / 180.0);
+    double sinZ = sin(z * PI / 180.0);
+    
+    double rotx[] = {1, 0, 0, 0, cosX, -sinX, 0, sinX, cosX};
+    double roty[] = {cosY, 0, sinY, 0, 1, 0, -sinY, 0, cosY};
+    double rotz[] = {cosZ, -sinZ, 0, sinZ, cosZ, 0, 0, 0, 1};
+    double step[12];
+    linearAffine(rotx, affine);
+    linearAffine(roty, step);
+    composeAffine(affine, step, affine);
+    linearAffine(rotz, step);
+    composeAffine(affine, step, affine);
+}
+
+void scaleAffine(float x, float y, float z, double *affine)
+{
+    double mat[] = {x, 0, 0, 0, y, 0, 0, 0, z};
+    linearAffine(mat, affine);
+}
+
+void translateAffine(float x, float y, float z, double *affine)
+{
+    scaleAffine(1.0f, 1.0f, 1.0f, affine);
+    affine[3]  = x;
+    affine[7]  = y;
+    affine[11] = z;
+}
+
+void composeAffine(const double *first, const double *second, double *out)
+{
+    double result[12];
+    for(uint r=0; r<3; r++) {
+        for(uint c=0; c<4; c++) {
+            result[4*r+c] = second[4*r+0] * first[0+c] +
+                            second[4*r+1] * first[4+c] +
+                            second[4*r+2] * first[8+c];
+        }
+        result[4*r+3] += second[4*r+3];
+    }
+    for(uint k=0; k<12; k++)
+        out[k] = result[k];
+}
+
+// The vertex transform.  Each coordinate is worked out in double
+// precision as  m0*x + m1*y + m2*z + t,  in that order and without
+// fused multiply-adds, then rounded to float, so the vector kernel
+// below gives bit for bit the same results as this reference one
+static void transformScalar(float *verts, uint begin, uint end,
+                            const double *affine)
+{
+    for (uint i = begin; i < end; ++i) {
+        double p[3] = { verts[i*3], verts[i*3+1], verts[i*3+2] };
+        for (uint r = 0; r < 3; ++r) {
+            verts[i*3+r] = float(affine[4*r+0] * p[0] +
+                                 affine[4*r+1] * p[1] +
+                                 affine[4*r+2] * p[2] +
+                                 affine[4*r+3]);
+        }
+    }
+}
+
+// vertices are staged in runs of this many: pulled apart into x, y
+// and z arrays, transformed four at a time, and put back together
+static const uint AFFINE_BLOCK = 256;
+// threads take this many vertices at a time; smaller meshes are not
+// worth splitting up
+static const uint AFFINE_CHUNK = 1 << 15;
+
+#ifdef CORK_AFFINE_AVX2
+__attribute__((target("avx2")))
+static void transformAVX2(float *verts, uint begin, uint end,
+                          const double *affine)
+{
+    __m256d m[12];
+    for (uint k = 0; k < 12; ++k)
+        m[k] = _mm256_set1_pd(affine[k]);
+    
+    alignas(32) float in[3][AFFINE_BLOCK];
+    alignas(32) float out[3][AFFINE_BLOCK];
+    for (uint block = begin; block < end; block += AFFINE_BLOCK) {
+        uint n = std::min(AFFINE_BLOCK, end - block);
+        float *v = verts + 3*block;
+        for (uint i = 0; i < n; ++i) {
+            in[0][i] = v[i*3];
+            in[1][i] = v[i*3+1];
+            in[2][i] = v[i*3+2];
+        }
+        uint i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d x = _mm256_cvtps_pd(_mm_load_ps(in[0] + i));
+            __m256d y = _mm256_cvtps_pd(_mm_load_ps(in[1] + i));
+            __m256d z = _mm256_cvtps_pd(_mm_load_ps(in[2] + i));
+            for (uint r = 0; r < 3; ++r) {
+                __m256d acc = _mm256_mul_pd(m[4*r+0], x);
+                acc = _mm256_add_pd(acc, _mm256_mul_pd(m[4*r+1], y));
+                acc = _mm256_add_pd(acc, _mm256_mul_pd(m[4*r+2], z));
+                acc = _mm256_add_pd(acc, m[4*r+3]);
+                _mm_store_ps(out[r] + i, _mm256_cvtpd_ps(acc));
+            }
+        }
+        for (; i < n; ++i) {
+            double p[3] = { in[0][i], in[1][i], in[2][i] };
+            for (uint r = 0; r < 3; ++r) {
+                out[r][i] = float(affine[4*r+0] * p[0] +
+                                  affine[4*r+1] * p[1] +
+                                  affine[4*r+2] * p[2] +
+                                  affine[4*r+3]);
+            }
+        }
+        for (uint i = 0; i < n; ++i) {
+            v[i*3]   = out[0][i];
+            v[i*3+1] = out[1][i];
+            v[i*3+2] = out[2][i];
+        }
+    }
+}
+#endif
+
+void transformCorkScalar(CorkTriMesh *mesh, const double *affine)
+{
+    transformScalar(mesh->vertices, 0, mesh->n_vertices, affine);
+}
+
+void transformCork(CorkTriMesh *mesh, const double *affine)
+{
+    void (*kernel)(float *, uint, uint, const double *) = transformScalar;
+#ifdef CORK_AFFINE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        kernel = transformAVX2;
+#endif
+    
+    uint n = mesh->n_vertices;
+    uint nchunks = (n + AFFINE_CHUNK - 1) / AFFINE_CHUNK;
+    parallel_for(nchunks, 0, [&](uint chunk) {
+        uint begin = chunk * AFFINE_CHUNK;
+        kernel(mesh->vertices, begin, std::min(n, begin + AFFINE_CHUNK),
+               affine);
+    });
+}
+
+
+// END SHAPESHIFTER
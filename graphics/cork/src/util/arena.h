@@ -0,0 +1,231 @@
+// +-------------------------------------------------------------------------
+// | arena.h
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include "prelude.h"
+
+#include <new>
+#include <cstddef>
+#include <functional>
+
+/*
+ *  Arena is a bump-pointer allocator for short-lived scratch objects.
+ *  Individual allocations are never returned to the arena; instead,
+ *  all of the memory is released wholesale by reset() or when the
+ *  arena is destroyed.  Allocations made one after another are laid
+ *  out next to each other in memory.
+ *
+ *      An Arena is not synchronized.  Each thread that needs scratch
+ *  space should own its own arena (e.g. one per IsctProblem).
+ *
+ *      Like MemPool, Arena does not invoke constructors or destructors.
+ *  ArenaPool<T> (below) layers that bookkeeping on top of an Arena.
+ */
+
+class Arena
+{
+public: // constructor/destructor
+    Arena(size_t minInitBytes = 4096);
+    ~Arena();
+private: // seal off copying behavior from clients
+    Arena(const Arena &) {}
+    Arena& operator=(const Arena &) { return *this; }
+    
+public: // main use functions
+    inline void* alloc(size_t size, size_t align);
+    
+    // forget every allocation, but hang on to the largest chunk
+    // so that refilling the arena does not hit the system allocator
+    void reset();
+
+private: // internal data structures
+    struct Chunk {
+        Chunk  *next;
+        size_t  nBytes;     // usable bytes following this header
+    };
+    static inline byte* chunkData(Chunk *chunk) {
+        return reinterpret_cast<byte*>(chunk) + sizeof(Chunk);
+    }
+private: // internal data instances
+    Chunk  *chunk_list;     // most recent (and largest) chunk first
+    byte   *cursor;         // next free byte in the current chunk
+    byte   *limit;          // one past the last byte in the current chunk
+private: // helper functions
+    void addChunk(size_t minBytes);
+};
+
+inline Arena::Arena(size_t minInitBytes) :
+    chunk_list(nullptr), cursor(nullptr), limit(nullptr)
+{
+    addChunk(std::max(minInitBytes, size_t(256)));
+}
+
+inline Arena::~Arena()
+{
+    while(chunk_list != nullptr) {
+        Chunk *next = chunk_list->next;
+        delete[] reinterpret_cast<byte*>(chunk_list);
+        chunk_list = next;
+    }
+}
+
+inline void* Arena::alloc(size_t size, size_t align)
+{
+    // round the cursor up to the requested alignment
+    size_t      misalign    = size_t(cursor) & (align-1);
+    byte       *ptr         = cursor + ((misalign)? align - misalign : 0);
+    if(ptr + size > limit) {
+        addChunk(size + align);
+        misalign            = size_t(cursor) & (align-1);
+        ptr                 = cursor + ((misalign)? align - misalign : 0);
+    }
+    cursor                  = ptr + size;
+    return ptr;
+}
+
+inline void Arena::reset()
+{
+    // keep only the head chunk, which is always the largest
+    Chunk *chunk = chunk_list->next;
+    while(chunk != nullptr) {
+        Chunk *next = chunk->next;
+        delete[] reinterpret_cast<byte*>(chunk);
+        chunk = next;
+    }
+    chunk_list->next    = nullptr;
+    cursor              = chunkData(chunk_list);
+    limit               = cursor + chunk_list->nBytes;
+}
+
+inline void Arena::addChunk(size_t minBytes)
+{
+    // we always (at least) double the size of each new chunk, so the
+    // number of system allocations is logarithmic in the total usage.
+    size_t nBytes = (chunk_list)? chunk_list->nBytes * 2 : minBytes;
+    nBytes = std::max(nBytes, minBytes);
+    
+    Chunk *chunk    = reinterpret_cast<Chunk*>(
+                        new byte[sizeof(Chunk) + nBytes]);
+    chunk->next     = chunk_list;
+    chunk->nBytes   = nBytes;
+    chunk_list      = chunk;
+    cursor          = chunkData(chunk);
+    limit           = cursor + nBytes;
+}
+
+
+/*
+ *  ArenaPool<T> offers the same interface as IterPool<T>, but carves
+ *  its objects out of a shared Arena.  Several pools of different types
+ *  can draw from one arena, so that all the objects they create
+ *  live together and are released together.
+ *
+ *      free() runs the destructor and unlinks the object from iteration,
+ *  but the memory is only reclaimed once the arena is reset.
+ *  The owner of the arena must clear() or destroy every pool drawing
+ *  from it before calling Arena::reset().
+ */
+template<class T>
+class ArenaPool
+{
+public:
+    ArenaPool(Arena &src) :
+        numAlloced(0), block_list(nullptr), arena(&src)
+    {}
+    ~ArenaPool() {
+        destructAll();
+    }
+    
+    void clear() {
+        destructAll();
+        numAlloced = 0;
+        block_list = nullptr;
+    }
+private: // seal off copying behavior from clients
+    ArenaPool(const ArenaPool &) {}
+    ArenaPool& operator=(const ArenaPool &) { return *this; }
+    
+private:
+    struct Block {
+        T       datum;
+        Block   *next;
+        Block   *prev;
+    };
+    
+    void destructAll() {
+        for(Block *block = block_list; block != nullptr; block = block->next)
+            ((T*)(block))->~T();
+    }
+    
+public: // allocation/deallocation support
+    T* alloc() {
+        Block *new_block = static_cast<Block*>(
+                            arena->alloc(sizeof(Block), alignof(Block)));
+        if(block_list) block_list->prev = new_block;
+        new_block->next = block_list;
+        new_block->prev = nullptr;
+        block_list = new_block;
+        
+        T* obj = (T*)new_block;
+        new (obj) T(); // invoke default constructor when allocating
+        
+        numAlloced++;
+        
+        return obj;
+    }
+    void free(T* item) {
+        if(item == nullptr)   return;
+        item->~T(); // invoke destructor before releasing
+        
+        numAlloced--;
+        
+        Block *ptr = (Block*)(item);
+        if(ptr->next)   ptr->next->prev = ptr->prev;
+        if(ptr->prev)   ptr->prev->next = ptr->next;
+        if(ptr == block_list)   block_list = ptr->next;
+        // the memory itself stays with the arena until it is reset
+    }
+    
+public:
+    // templated visitor; the functor gets inlined into the loop
+    template<class Func>
+    inline void for_each(Func func) const {
+        for(Block *block = block_list;
+          block != nullptr;
+          block = block->next) {
+            func((T*)(block));
+        }
+    }
+    inline void for_each(std::function<void(T*)> func) const {
+        for_each< std::function<void(T*)> & >(func);
+    }
+    inline uint size() const {
+        return numAlloced;
+    }
+    
+private:
+    uint    numAlloced;
+    Block   *block_list;
+    Arena   *arena;
+};
@@ -0,0 +1,156 @@
+// +-------------------------------------------------------------------------
+// | indexedHeap.h
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include "prelude.h"
+
+#include <vector>
+
+// +-------------------------------------------------------------------------
+// | WHAT IS THIS?
+// | 
+// | An IndexedHeap is a d-ary max-heap of (key, item) pairs which
+// | supports changing or removing the key of an item already in the heap.
+// | To make that O(log n) without a search, every item carries a slot
+// | in which the heap records the item's current position.
+// |
+// | The slot is found with the IndexOf functor, which must return
+// | a uint& for a given item.  Items not in the heap must have
+// | their slot set to IndexedHeap::NOT_IN_HEAP before first use.
+// |
+// | Ties between equal keys are broken arbitrarily.
+// +-------------------------------------------------------------------------
+
+template<class T, class IndexOf, uint D = 4>
+class IndexedHeap
+{
+public:
+    static const uint NOT_IN_HEAP = uint(-1);
+    
+    IndexedHeap(IndexOf index_of = IndexOf()) : slot(index_of) {}
+    ~IndexedHeap() {}
+    
+    inline uint size() const { return entries.size(); }
+    inline bool empty() const { return entries.empty(); }
+    inline void reserve(uint n) { entries.reserve(n); }
+    
+    inline bool contains(T item) { return slot(item) != NOT_IN_HEAP; }
+    
+    // the item with the largest key
+    inline T top() const { return entries[0].item; }
+    inline double topKey() const { return entries[0].key; }
+    
+    inline T pop() {
+        T item = entries[0].item;
+        removeAt(0);
+        return item;
+    }
+    
+    // insert the item, or move it if it's already present
+    inline void update(T item, double key) {
+        uint i = slot(item);
+        if(i == NOT_IN_HEAP) {
+            i = entries.size();
+            entries.push_back(Entry(key, item));
+            slot(item) = i;
+            siftUp(i);
+        } else {
+            double old_key = entries[i].key;
+            entries[i].key = key;
+            if(key > old_key)   siftUp(i);
+            else                siftDown(i);
+        }
+    }
+    
+    // no-op if the item is not present
+    inline void remove(T item) {
+        uint i = slot(item);
+        if(i != NOT_IN_HEAP)
+            removeAt(i);
+    }
+    
+private:
+    struct Entry {
+        double  key;
+        T       item;
+        inline Entry(double k, T t) : key(k), item(t) {}
+    };
+    
+    inline void place(uint i, const Entry &entry) {
+        entries[i] = entry;
+        slot(entry.item) = i;
+    }
+    
+    inline void removeAt(uint i) {
+        slot(entries[i].item) = NOT_IN_HEAP;
+        uint last = entries.size() - 1;
+        if(i != last) {
+            place(i, entries[last]);
+            entries.pop_back();
+            // the moved entry could belong either above or below i
+            if(i > 0 && entries[i].key > entries[(i-1)/D].key)
+                siftUp(i);
+            else
+                siftDown(i);
+        } else {
+            entries.pop_back();
+        }
+    }
+    
+    inline void siftUp(uint i) {
+        Entry moving = entries[i];
+        while(i > 0) {
+            uint parent = (i-1)/D;
+            if(!(moving.key > entries[parent].key))
+                break;
+            place(i, entries[parent]);
+            i = parent;
+        }
+        place(i, moving);
+    }
+    
+    inline void siftDown(uint i) {
+        Entry moving = entries[i];
+        uint N = entries.size();
+        while(true) {
+            uint first = D*i + 1;
+            if(first >= N)  break;
+            uint last = std::min(first + D, N);
+            uint best = first;
+            for(uint c = first+1; c < last; c++)
+                if(entries[c].key > entries[best].key)
+                    best = c;
+            if(!(entries[best].key > moving.key))
+                break;
+            place(i, entries[best]);
+            i = best;
+        }
+        place(i, moving);
+    }
+    
+private:
+    std::vector<Entry>  entries;
+    IndexOf             slot;
+};
+
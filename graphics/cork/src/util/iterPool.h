@@ -133,13 +133,18 @@ public: // allocation/deallocation support
     }
     
 public:
-    inline void for_each(std::function<void(T*)> func) const {
+    // templated visitor; the functor gets inlined into the loop
+    template<class Func>
+    inline void for_each(Func func) const {
         for(Block *block = block_list;
           block != NULL;
           block = block->next) {
             func((T*)(block));
         }
     }
+    inline void for_each(std::function<void(T*)> func) const {
+        for_each< std::function<void(T*)> & >(func);
+    }
     inline bool contains(T* tptr) const {
         for(Block *block = block_list;
           block != NULL;
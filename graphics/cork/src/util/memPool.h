@@ -27,6 +27,7 @@
 
 #include <new>
 #include <algorithm>
+#include <atomic>
 
 /*
  *  RESPONSIBILITIES OF THE USER / CLIENT CODE
@@ -205,5 +206,99 @@ void MemPool<T>::addChunk()
 
 
 
+/*
+ *  SharedMemPool<T> is a single MemPool of Ts for every thread.  Each
+ *  thread keeps a list of free blocks of its own, and only takes the
+ *  lock on the shared pool to refill that list, a batch of blocks at a
+ *  time, or to hand the whole list back when the thread exits.  So a
+ *  block may be freed on another thread than the one which allocated
+ *  it, or after that one has exited.  Blocks go back to the system when
+ *  the program exits.
+ */
+template<class T>
+class SharedMemPool
+{
+public:
+    static T* alloc();
+    static void free(T*);
+    
+private:
+    // a free block (MemPool blocks always have room for a pointer)
+    struct Node {
+        Node   *next;
+    };
+    // hands the thread's blocks back to the shared pool when it exits;
+    // kept apart from the list itself so alloc() and free() need not
+    // check whether the thread's copy has been constructed yet
+    struct Reclaimer {
+        ~Reclaimer();
+    };
+    static const uint BATCH = 64;
+    
+    static void lock() {
+        while(shared_lock.test_and_set(std::memory_order_acquire))
+            ;
+    }
+    static void unlock() {
+        shared_lock.clear(std::memory_order_release);
+    }
+    
+    static MemPool<T>               shared;
+    static std::atomic_flag         shared_lock;
+    static thread_local Node       *head;
+    static thread_local Reclaimer   reclaimer;
+};
+
+template<class T>
+MemPool<T> SharedMemPool<T>::shared;
+template<class T>
+std::atomic_flag SharedMemPool<T>::shared_lock = ATOMIC_FLAG_INIT;
+template<class T>
+thread_local typename SharedMemPool<T>::Node *SharedMemPool<T>::head = nullptr;
+template<class T>
+thread_local typename SharedMemPool<T>::Reclaimer SharedMemPool<T>::reclaimer;
 
+template<class T> inline
+T* SharedMemPool<T>::alloc()
+{
+    if(head == nullptr) {
+        (void)&reclaimer; // make sure this thread's blocks come back
+        // link the batch in the order the shared pool gave it out, so
+        // that consecutive allocations stay close together in memory
+        Node **tail = &head;
+        lock();
+        for(uint k=0; k<BATCH; k++) {
+            *tail = reinterpret_cast<Node*>(shared.alloc());
+            tail = &((*tail)->next);
+        }
+        unlock();
+        *tail = nullptr;
+    }
+    
+    Node *node = head;
+    head = node->next;
+    return reinterpret_cast<T*>(node);
+}
 
+template<class T> inline
+void SharedMemPool<T>::free(T* datum)
+{
+    if(datum == nullptr)    return;
+    if(head == nullptr)
+        (void)&reclaimer; // this may be the thread's first block
+    Node *node = reinterpret_cast<Node*>(datum);
+    node->next = head;
+    head = node;
+}
+
+template<class T>
+SharedMemPool<T>::Reclaimer::~Reclaimer()
+{
+    lock();
+    while(head != nullptr) {
+        Node *node = head;
+        head = node->next;
+        shared.free(reinterpret_cast<T*>(node));
+    }
+    unlock();
+}
@@ -0,0 +1,79 @@
+// +-------------------------------------------------------------------------
+// | parallel.h
+// | 
+// +-------------------------------------------------------------------------
+// | COPYRIGHT:
+// |    See the included COPYRIGHT file for further details.
+// |    
+// |    This file is part of the Cork library.
+// |
+// |    Cork is free software: you can redistribute it and/or modify
+// |    it under the terms of the GNU Lesser General Public License as
+// |    published by the Free Software Foundation, either version 3 of
+// |    the License, or (at your option) any later version.
+// |
+// |    Cork is distributed in the hope that it will be useful,
+// |    but WITHOUT ANY WARRANTY; without even the implied warranty of
+// |    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// |    GNU Lesser General Public License for more details.
+// |
+// |    You should have received a copy 
+// |    of the GNU Lesser General Public License
+// |    along with Cork.  If not, see <http://www.gnu.org/licenses/>.
+// +-------------------------------------------------------------------------
+#pragma once
+
+#include "prelude.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*
+ *  parallel_for(n, nthreads, body) calls body(i) for every i in [0, n),
+ *  spread over up to nthreads threads (0 picks one per hardware thread).
+ *  The calling thread does its share of the work, and the call returns
+ *  once every iteration has finished.
+ *
+ *      Iterations are handed out one at a time, so this suits a modest
+ *  number of chunky, uneven tasks rather than a tight loop.  The body
+ *  must be safe to run concurrently with itself.
+ *
+ *      A parallel_for called from within the body of another (a Boolean
+ *  solved as one of several groups, say) runs on the thread calling it
+ *  alone, as the outer one already has every thread busy.
+ */
+inline bool &inParallelFor()
+{
+    static thread_local bool inside = false;
+    return inside;
+}
+
+template<class Func>
+inline void parallel_for(uint n, uint nthreads, Func body)
+{
+    if(nthreads == 0)
+        nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, n);
+    if(nthreads <= 1 || inParallelFor()) {
+        for(uint i=0; i<n; i++)
+            body(i);
+        return;
+    }
+    
+    std::atomic<uint> next(0);
+    auto worker = [&]() {
+        inParallelFor() = true;
+        for(uint i = next++; i < n; i = next++)
+            body(i);
+        inParallelFor() = false;
+    };
+    
+    std::vector<std::thread> helpers;
+    for(uint k=1; k<nthreads; k++)
+        helpers.push_back(std::thread(worker));
+    worker();
+    for(std::thread &helper : helpers)
+        helper.join();
+}
+
@@ -85,7 +85,9 @@ private: // helper functions
     void resizeHelper(uint newsize);
     
 public: // shared data structures and data.
-    static MemPool< ShortVecBlock_Private<T,LEN> > pool;
+    // shared by every thread, as Booleans may run concurrently (see
+    // parallel_for), and a ShortVec made on one may be freed on another
+    typedef SharedMemPool< ShortVecBlock_Private<T,LEN> > Pool;
     
 private: // instance data
     uint user_size;     // actual number of entries from client perspective
@@ -94,16 +96,13 @@ private: // instance data
     T* data;
 };
 
-template<class T, uint LEN>
-MemPool< ShortVecBlock_Private<T,LEN> > ShortVec<T,LEN>::pool;
-
 template<class T, uint LEN> inline
 T* ShortVec<T,LEN>::allocData(uint space, uint &allocated)
 {
     T* result;
     if(space <= LEN) {
         allocated = LEN;
-        result =  reinterpret_cast<T*>(pool.alloc());
+        result =  reinterpret_cast<T*>(Pool::alloc());
     } else {
         allocated = space;
         result = reinterpret_cast<T*>(new byte[sizeof(T)*space]);
@@ -116,7 +115,7 @@ void ShortVec<T,LEN>::deallocData(T* data_ptr, uint allocated)
 {
     //if(LEN == 2) std::cout << "        Deallocing: " << data_ptr << std::endl;
     if(allocated <= LEN)
-        pool.free(reinterpret_cast< ShortVecBlock_Private<T,LEN>* >(data_ptr));
+        Pool::free(reinterpret_cast< ShortVecBlock_Private<T,LEN>* >(data_ptr));
     else
         delete[] reinterpret_cast<byte*>(data_ptr);
 }
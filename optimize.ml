@@ -0,0 +1,399 @@
+(* Optimization passes for the ShapeShifter compiler: rewrite a
+   semantically checked AST into a cheaper one with the same effects *)
+
+open Ast
+
+module StringMap = Map.Make(String)
+module StringSet = Set.Make(String)
+
+(* Names of the shape variables a function may rewrite freely: its shape
+   formals and locals, less any name that is also a global or is declared
+   with another type somewhere (which a name-based analysis can't tell
+   apart).  Shape formals are private copies, so writes to them are only
+   seen through the function's own statements *)
+let shape_names globals func =
+  let rec locals = function
+    | Block sl -> List.concat (List.map locals sl)
+    | If(_, s1, s2) -> locals s1 @ locals s2
+    | For(_, _, _, s) | While(_, s) -> locals s
+    | Local(t, s, _) -> [(t, s)]
+    | _ -> []
+  in
+  let binds = func.formals @ locals (Block func.body) in
+  let add_if p set (t, s) = if p t then StringSet.add s set else set in
+  StringSet.diff (List.fold_left (add_if ((=) Shape)) StringSet.empty binds)
+    (List.fold_left (add_if (fun _ -> true))
+       (List.fold_left (add_if ((<>) Shape)) StringSet.empty binds) globals)
+
+(* What a statement does, if all it does is compute a shape: the shape
+   it writes, whether it reads the old value of that shape too (as a
+   transform does), and the other shapes it reads *)
+let shape_effect shapes st =
+  let action = match st with
+    | Local(Shape, s, e) | Expr(Assign(s, e)) ->
+        (match e with
+          | SpherePrim | CubePrim | CylinderPrim | TetraPrim | ConePrim
+          | MeshLit _ -> Some (s, false, [])
+          | Id a -> Some (s, false, [a])
+          | Call(("Union" | "Intersect" | "Difference" | "Xor"),
+                 [Id a; Id b]) -> Some (s, false, [a; b])
+          | _ -> None)
+    | Expr(Call(("Translate" | "Rotate" | "Scale" | "Reflect" |
+                 "Simplify" | "Cut"), Id s :: _)) -> Some (s, true, [])
+    | Expr(Call("Copy", [Id a; Id b])) -> Some (b, false, [a])
+    | _ -> None
+  in
+  match action with
+    | Some (s, _, _) when StringSet.mem s shapes -> action
+    | _ -> None
+
+(* Names declared directly in a statement list *)
+let declared sl = List.fold_left (fun set -> function
+    | Local(_, s, _) -> StringSet.add s set
+    | _ -> set) StringSet.empty sl
+
+(**** Dead shape elimination ****)
+
+(* Each shape statement runs cork over the shape's file, so computing a
+   shape that nothing renders, saves, queries or returns is pure waste.
+   Sweep the statements backwards from the names needed after them,
+   dropping shape statements whose result is not needed, and return the
+   names needed before them with the statements kept.  A dead
+   declaration stays, without its initializer, so the name still exists.
+
+   Branches of an if are swept separately.  Anything else (loops, calls,
+   Render, Save, queries, print, return) is kept whole, and needs every
+   name it mentions *)
+let rec prune shapes needed body =
+  List.fold_left (fun (needed, kept) st ->
+      match st with
+        | Local(_, _, Noexpr) -> (needed, st :: kept)
+        | Block sl ->
+            (* names the block declares shadow those needed after it *)
+            let (n, sl) = prune shapes needed sl in
+            (StringSet.union n (StringSet.inter needed (declared sl)),
+             Block sl :: kept)
+        | If(p, s1, s2) ->
+            let (n1, b1) = prune shapes needed [s1]
+            and (n2, b2) = prune shapes needed [s2] in
+            (List.fold_right StringSet.add (Semant.ids_of_expr p)
+               (StringSet.union n1 n2), If(p, Block b1, Block b2) :: kept)
+        | _ ->
+            (match shape_effect shapes st with
+              | Some (s, _, _) when not (StringSet.mem s needed) ->
+                  (needed, (match st with
+                             | Local(t, _, _) -> Local(t, s, Noexpr) :: kept
+                             | _ -> kept))
+              | Some (s, updates, reads) ->
+                  let needed =
+                    if updates then needed else StringSet.remove s needed in
+                  (List.fold_right StringSet.add reads needed, st :: kept)
+              | None ->
+                  (List.fold_right StringSet.add (Semant.ids_of_stmt st)
+                     needed, st :: kept))
+    ) (needed, []) (List.rev body)
+
+let eliminate_dead_shapes globals func =
+  let shapes = shape_names globals func in
+  { func with body = snd (prune shapes StringSet.empty func.body) }
+
+(**** Common shape elimination ****)
+
+(* Shapes are numbered by value: two shapes get the same number when
+   they were built by the same operations, with the same literal
+   arguments, from values with the same numbers.  A statement that
+   computes a value some other shape still holds becomes a copy of that
+   shape, which cork shares by a link instead of computing it again *)
+
+type value = Number of int | Key of string | Unknown
+
+let value_count = ref 0
+
+let literal = function
+  | IntLit _ | DblLit _ | Unop(Neg, (IntLit _ | DblLit _)) as e ->
+      Some (string_of_expr e)
+  | _ -> None
+
+(* Names an expression or a statement may write *)
+let rec writes_of_expr = function
+  | Assign(s, e) -> s :: writes_of_expr e
+  | Call(("Translate" | "Rotate" | "Scale" | "Reflect" | "Simplify" |
+          "Cut"), Id s :: _) -> [s]
+  | Call("Copy", [_; Id b]) -> [b]
+  | Call(_, el) -> List.concat (List.map writes_of_expr el)
+  | Binop(e1, _, e2) -> writes_of_expr e1 @ writes_of_expr e2
+  | Unop(_, e) -> writes_of_expr e
+  | _ -> []
+
+let rec writes_of_stmt = function
+  | Block sl -> List.concat (List.map writes_of_stmt sl)
+  | Expr e | Return e -> writes_of_expr e
+  | If(p, s1, s2) -> writes_of_expr p @ writes_of_stmt s1 @ writes_of_stmt s2
+  | For(e1, e2, e3, s) -> writes_of_expr e1 @ writes_of_expr e2 @
+                          writes_of_expr e3 @ writes_of_stmt s
+  | While(p, s) -> writes_of_expr p @ writes_of_stmt s
+  | Local(_, s, e) -> s :: writes_of_expr e
+
+(* The shape a statement writes and the value it computes, if that is
+   all the statement does.  An operation is keyed by its name and its
+   literal arguments and operand numbers; the operands of a union or an
+   intersection are sorted, since those commute *)
+let computed shapes vars st =
+  let operand a =
+    try Some ("#" ^ string_of_int (StringMap.find a vars))
+    with Not_found -> None in
+  let number a =
+    try Number (StringMap.find a vars) with Not_found -> Unknown in
+  let key f parts =
+    if List.mem None parts then Unknown else
+    Key (f ^ "(" ^ String.concat ","
+           (List.map (function Some p -> p | None -> "") parts) ^ ")") in
+  let result = match st with
+    | Local(Shape, s, e) | Expr(Assign(s, e)) ->
+        Some (s, (match e with
+          | SpherePrim | CubePrim | CylinderPrim | TetraPrim | ConePrim ->
+              Key (string_of_expr e)
+          | MeshLit f -> Key ("Mesh " ^ f)
+          | Id a -> number a
+          | Call(("Union" | "Intersect") as f, [Id a; Id b]) ->
+              key f (List.sort compare [operand a; operand b])
+          | Call("Difference", [Id a; Id b]) ->
+              key "Difference" [operand a; operand b]
+          | _ -> Unknown))
+    | Expr(Call(("Translate" | "Rotate" | "Scale" | "Reflect" | "Simplify" |
+                 "Cut") as f, Id s :: args)) ->
+        Some (s, key f (operand s :: List.map literal args))
+    | Expr(Call("Copy", [Id a; Id b])) -> Some (b, number a)
+    | _ -> None
+  in
+  match result with
+    | Some (s, _) when StringSet.mem s shapes -> result
+    | _ -> None
+
+(* Sweep the statements forwards from the numbers the shapes hold (vars)
+   and the numbers given to operations so far (table), rewriting the
+   statements that recompute a held value into copies.  Anything that
+   isn't a plain shape statement forgets the shapes it may write; the
+   branches of an if and nested blocks are swept from the state before
+   them, and forget whatever they write once done *)
+let rec share shapes (vars, table) body =
+  let holder vars n s = StringMap.fold (fun v m found ->
+      if m = n && v <> s && found = None then Some v else found) vars None in
+  let forget vars names =
+    List.fold_left (fun vars s -> StringMap.remove s vars) vars names in
+  let step ((vars, table), kept) st =
+    match st with
+      | Block sl ->
+          let (_, sl) = share shapes (vars, table) sl in
+          ((forget vars (writes_of_stmt st), table), Block sl :: kept)
+      | If(p, s1, s2) ->
+          let state = (forget vars (writes_of_expr p), table) in
+          let (_, b1) = share shapes state [s1]
+          and (_, b2) = share shapes state [s2] in
+          ((forget vars (writes_of_stmt st), table),
+           If(p, Block b1, Block b2) :: kept)
+      | _ ->
+          (match computed shapes vars st with
+            | None -> ((forget vars (writes_of_stmt st), table), st :: kept)
+            | Some (s, Unknown) -> ((StringMap.remove s vars, table), st :: kept)
+            | Some (s, Number n) -> ((StringMap.add s n vars, table), st :: kept)
+            | Some (s, Key k) ->
+                let (n, table) =
+                  try (StringMap.find k table, table) with Not_found ->
+                    incr value_count;
+                    (!value_count, StringMap.add k !value_count table) in
+                let st = match holder vars n s, st with
+                  | Some t, Local(ty, _, _) -> Local(ty, s, Id t)
+                  | Some t, _ -> Expr(Assign(s, Id t))
+                  | None, _ -> st in
+                ((StringMap.add s n vars, table), st :: kept))
+  in
+  let (state, kept) = List.fold_left step ((vars, table), []) body in
+  (state, List.rev kept)
+
+let share_common_shapes globals func =
+  let shapes = shape_names globals func in
+  let empty = (StringMap.empty, StringMap.empty) in
+  { func with body = snd (share shapes empty func.body) }
+
+(**** Constant shape folding ****)
+
+(* A shape built only from primitives by transforms and booleans with
+   literal arguments is known before the program runs.  Build each such
+   shape with cork while compiling, and have the program write out the
+   finished mesh (a MeshLit, embedded by codegen) instead of running cork
+   for it.  Built meshes are cached on disk, named by a digest of how
+   they were built, so compiling the same script again runs nothing.
+
+   Transforms are not built: the program only leaves them pending beside
+   the shape's file (cork -lazy), which costs no pass over the mesh.  A
+   known shape is thus a mesh file and the transforms pending on it, and
+   whatever is built from it replays them the same way, so that folding
+   computes exactly what the program would *)
+
+let cork_exec = "./graphics/cork/bin/cork"
+let cork_digest = lazy (Digest.to_hex (Digest.file cork_exec))
+let cache_folder = "./.shapecache/"
+
+let prim_file = function
+  | ConePrim -> Some "./graphics/.primitives/cone.off"
+  | CubePrim -> Some "./graphics/.primitives/cube.off"
+  | CylinderPrim -> Some "./graphics/.primitives/cylinder.off"
+  | SpherePrim -> Some "./graphics/.primitives/sphere.off"
+  | TetraPrim -> Some "./graphics/.primitives/tetra.off"
+  | _ -> None
+
+(* A known shape: how it was built, the file holding its mesh, whether
+   that file was built here (rather than being a primitive's), and the
+   transforms pending on it, oldest first, as a cork option and its
+   arguments *)
+type constant = { key : string; file : string; built : bool;
+                  steps : (string * string list) list }
+
+(* The commands that leave c in the file out as the program would have
+   it: a copy of c's mesh with c's transforms pending *)
+let replay c out =
+  String.concat " && "
+    (String.concat " " [cork_exec; "-copy"; c.file; out] ::
+     List.map (fun (op, args) ->
+         String.concat " " (cork_exec :: "-lazy" :: op :: out :: args))
+       c.steps)
+
+(* Find the mesh for key in the cache, or build it with cork: make
+   writes the mesh to the file it is given.  The cache is keyed by the
+   cork binary too, so rebuilding cork starts it afresh.  Build under a
+   scratch name and rename, so a build that fails or is cut short leaves
+   nothing *)
+let cached key make =
+  let digest = Digest.string (Lazy.force cork_digest ^ " " ^ key) in
+  let file = cache_folder ^ Digest.to_hex digest ^ ".off" in
+  let found = { key = key; file = file; built = true; steps = [] } in
+  if Sys.file_exists file then Some found
+  else
+    let scratch = file ^ ".new.off" in
+    let cleanup () = List.iter (fun f ->
+        if Sys.file_exists f then Sys.remove f) [scratch; scratch ^ ".xf"] in
+    if Sys.command ("mkdir -p " ^ cache_folder) = 0 &&
+       Sys.command ("(" ^ make scratch ^ ") > /dev/null") = 0 &&
+       Sys.file_exists scratch
+    then (Sys.rename scratch file; cleanup (); Some found)
+    else (cleanup (); None)
+
+(* The shape a statement writes and its value if it is known (built
+   now if need be), when that is all the statement does *)
+let constant shapes consts st =
+  let known a = try Some (StringMap.find a consts) with Not_found -> None in
+  let args_of el = List.map literal el in
+  let result = match st with
+    | Local(Shape, s, e) | Expr(Assign(s, e)) ->
+        Some (s, (match e with
+          | SpherePrim | CubePrim | CylinderPrim | TetraPrim | ConePrim ->
+              (match prim_file e with
+                | Some f when Sys.file_exists f ->
+                    Some { key = string_of_expr e ^ " " ^
+                                 Digest.to_hex (Digest.file f);
+                           file = f; built = false; steps = [] }
+                | _ -> None)
+          | Id a -> (match known a with
+              | Some c -> Some { c with built = false }
+              | None -> None)
+          | Call(("Union" | "Intersect" | "Difference") as f, [Id a; Id b]) ->
+              (match known a, known b with
+                | Some ca, Some cb ->
+                    let op = List.assoc f [("Union", "-union");
+                        ("Intersect", "-isct"); ("Difference", "-diff")] in
+                    (* operands with pending transforms are replayed into
+                       scratch files beside out, removed once done *)
+                    cached (f ^ "(" ^ ca.key ^ "," ^ cb.key ^ ")")
+                      (fun out ->
+                        let operand c scratch =
+                          if c.steps = [] then ([], c.file)
+                          else ([replay c scratch], scratch) in
+                        let (pa, fa) = operand ca (out ^ ".a.off")
+                        and (pb, fb) = operand cb (out ^ ".b.off") in
+                        String.concat " && " (pa @ pb @
+                          [String.concat " " [cork_exec; op; fa; fb; out]]) ^
+                        "; status=$?; rm -f " ^ String.concat " "
+                          (List.map ((^) out) [".a.off"; ".a.off.xf";
+                                               ".b.off"; ".b.off.xf"]) ^
+                        "; exit $status")
+                | _ -> None)
+          | _ -> None))
+    | Expr(Call(("Translate" | "Rotate" | "Scale" | "Reflect") as f,
+                Id s :: el)) ->
+        Some (s, (match known s with
+          | Some c when not (List.mem None (args_of el)) ->
+              let args = List.map (function Some l -> l | None -> "")
+                           (args_of el) in
+              let op = List.assoc f [("Translate", "-translate");
+                  ("Rotate", "-rotate"); ("Scale", "-scale");
+                  ("Reflect", "-reflect")] in
+              Some { c with
+                     key = f ^ "(" ^ String.concat "," (c.key :: args) ^ ")";
+                     built = false; steps = c.steps @ [(op, args)] }
+          | _ -> None))
+    | Expr(Call(("Simplify" | "Cut") as f, Id s :: el)) ->
+        Some (s, (match known s with
+          | Some c when not (List.mem None (args_of el)) ->
+              let args = List.map (function Some l -> l | None -> "")
+                           (args_of el) in
+              let op = List.assoc f [("Simplify", "-simplify");
+                  ("Cut", "-cut")] in
+              cached (f ^ "(" ^ String.concat "," (c.key :: args) ^ ")")
+                (fun out -> replay c out ^ " && " ^
+                            String.concat " " (cork_exec :: op :: out :: args))
+          | _ -> None))
+    | Expr(Call("Copy", [Id a; Id b])) ->
+        Some (b, (match known a with
+          | Some c -> Some { c with built = false }
+          | None -> None))
+    | _ -> None
+  in
+  match result with
+    | Some (s, _) when StringSet.mem s shapes -> result
+    | _ -> None
+
+(* Sweep the statements forwards from the shapes known so far (consts),
+   turning each statement that builds a known shape into an assignment
+   of the built mesh.  Blocks and branches are handled as in share *)
+let rec fold shapes consts body =
+  let forget consts names =
+    List.fold_left (fun consts s -> StringMap.remove s consts) consts names in
+  let step (consts, kept) st =
+    match st with
+      | Block sl ->
+          let (_, sl) = fold shapes consts sl in
+          (forget consts (writes_of_stmt st), Block sl :: kept)
+      | If(p, s1, s2) ->
+          let inner = forget consts (writes_of_expr p) in
+          let (_, b1) = fold shapes inner [s1]
+          and (_, b2) = fold shapes inner [s2] in
+          (forget consts (writes_of_stmt st), If(p, Block b1, Block b2) :: kept)
+      | _ ->
+          (match constant shapes consts st with
+            | None -> (forget consts (writes_of_stmt st), st :: kept)
+            | Some (s, None) -> (StringMap.remove s consts, st :: kept)
+            | Some (s, Some c) ->
+                let st = match st with
+                  | _ when not c.built -> st
+                  | Local(t, _, _) -> Local(t, s, MeshLit c.file)
+                  | _ -> Expr(Assign(s, MeshLit c.file)) in
+                (StringMap.add s c consts, st :: kept))
+  in
+  let (consts, kept) = List.fold_left step (consts, []) body in
+  (consts, List.rev kept)
+
+let fold_constant_shapes globals func =
+  if not (Sys.file_exists cork_exec) then func else
+  let shapes = shape_names globals func in
+  { func with body = snd (fold shapes StringMap.empty func.body) }
+
+(* Run every pass over a checked program: folding (unless folding is
+   false) leaves the steps that built a known shape dead, and sharing
+   common shapes can leave more *)
+let program folding (globals, functions) =
+  (globals, List.map (fun func ->
+      let func = if folding then fold_constant_shapes globals func
+                 else func in
+      eliminate_dead_shapes globals (share_common_shapes globals func))
+    functions)
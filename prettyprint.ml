@@ -92,6 +92,7 @@
 | CylinderPrim -> "CylinderPrim"
 | CubePrim -> "CubePrim"
 | SpherePrim -> "SpherePrim"
+| MeshLit(x) -> "MeshLit(" ^ string_of_string x^")"
 | BoolLit(x) -> "BoolLit(" ^ string_of_bool x^")"
 | StrLit(x) -> "StrLit(" ^ string_of_string x^")"
 | DblLit(x) -> "DblLit(" ^ string_of_float x^")"
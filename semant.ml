@@ -62,6 +62,12 @@ let check (globals, functions) =
           ("Scale", { typ = Void; fname = "Scale"; formals = []; body = [] });
           ("Rotate", { typ = Void; fname = "Rotate"; formals = []; body = [] });
           ("Translate", { typ = Void; fname = "Translate"; formals = []; body = [] });
+          ("Simplify", { typ = Void; fname = "Simplify"; formals = []; body = [] });
+          ("Cut", { typ = Void; fname = "Cut"; formals = []; body = [] });
+          ("Intersects", { typ = Bool; fname = "Intersects"; formals = []; body = [] });
+          ("Contains", { typ = Bool; fname = "Contains"; formals = []; body = [] });
+          ("Hits", { typ = Bool; fname = "Hits"; formals = []; body = [] });
+          ("Within", { typ = Bool; fname = "Within"; formals = []; body = [] });
           ("print", { typ = Void; fname = "print"; formals = [(Int, "x")]; body = [] });
           ("printb", { typ = Void; fname = "printb"; formals = [(Bool, "x")]; body = [] });
       ]
@@ -141,6 +147,7 @@ let check (globals, functions) =
       | CylinderPrim -> Shape
       | TetraPrim -> Shape
       | ConePrim -> Shape
+      | MeshLit _ -> Shape
     in
 
     let check_bool_expr e = if expr e != Bool
@@ -174,3 +181,47 @@ let check (globals, functions) =
     stmt (Block func.body)
   in
   List.iter check_function functions
+
+(**** Shape liveness ****)
+
+(* Every shape variable is backed by a file, which codegen can release
+   as soon as no later statement reads or writes the variable *)
+
+(* Names mentioned by an expression or a statement *)
+let rec ids_of_expr = function
+  | Id s -> [s]
+  | Binop(e1, _, e2) -> ids_of_expr e1 @ ids_of_expr e2
+  | Unop(_, e) -> ids_of_expr e
+  | Assign(s, e) -> s :: ids_of_expr e
+  | Call(_, el) -> List.concat (List.map ids_of_expr el)
+  | _ -> []
+
+let rec ids_of_stmt = function
+  | Block sl -> List.concat (List.map ids_of_stmt sl)
+  | Expr e | Return e -> ids_of_expr e
+  | If(p, s1, s2) -> ids_of_expr p @ ids_of_stmt s1 @ ids_of_stmt s2
+  | For(e1, e2, e3, s) -> ids_of_expr e1 @ ids_of_expr e2 @
+                          ids_of_expr e3 @ ids_of_stmt s
+  | While(p, s) -> ids_of_expr p @ ids_of_stmt s
+  | Local(_, s, e) -> s :: ids_of_expr e
+
+(* Pair each statement of a function's body with the shape variables
+   that are dead once it has run: the shape formals and the shapes
+   declared in the body itself (not in nested blocks, whose files are
+   reused on every pass through a loop), after the last statement that
+   mentions them.  A use anywhere inside a nested block or loop keeps
+   the shape live until that whole statement is done *)
+let shape_last_uses func =
+  let shapes =
+    List.map snd (List.filter (fun (t, _) -> t = Shape) func.formals) @
+    List.fold_left (fun l -> function
+        | Local(Shape, s, _) -> s :: l
+        | _ -> l) [] func.body
+  in
+  let (_, uses) = List.fold_left (fun (seen, uses) st ->
+      let dead = List.filter
+          (fun s -> List.mem s shapes && not (List.mem s seen))
+          (List.sort_uniq compare (ids_of_stmt st)) in
+      (dead @ seen, (st, dead) :: uses)) ([], []) (List.rev func.body)
+  in
+  uses
@@ -5,13 +5,18 @@ type action = Ast | PrettyPrint | LLVM_IR | Compile | Help
 
 
 let get_info = (
-	"Usage: ./shapeshifter [optional flag] < <source file>\n")
+	"Usage: ./shapeshifter [optional flag] [-nofold] < <source file>\n" ^
+	"  -nofold  build every shape when the program runs, none while compiling\n")
 
 let _ =
   (*try *)
+  	(* -nofold may come with any other flag *)
+  	let args = List.tl (Array.to_list Sys.argv) in
+  	let fold = not (List.mem "-nofold" args) in
+  	let args = List.filter ((<>) "-nofold") args in
   	let action = 
-		if Array.length Sys.argv > 1 then
-    			List.assoc Sys.argv.(1) [ ("-a", Ast);	(* Print the AST only *)
+		if args <> [] then
+    			List.assoc (List.hd args) [ ("-a", Ast);	(* Print the AST only *)
                               		("-p", PrettyPrint); (* Pretty-print the AST *)
                               		("-l", LLVM_IR);  (* Generate LLVM, don't check *)
                               		("-c", Compile); (* Generate, check LLVM IR *)
@@ -26,8 +31,8 @@ let _ =
     		| Help -> print_string get_info
 		    | Ast -> print_string (Ast.string_of_program ast)
     		| PrettyPrint -> print_string (Prettyprint.string_of_program ast)
-    		| LLVM_IR -> print_string (Llvm.string_of_llmodule (Codegen.translate ast))
-    		| Compile -> let m = Codegen.translate ast in
+    		| LLVM_IR -> print_string (Llvm.string_of_llmodule (Codegen.translate (Optimize.program fold ast)))
+    		| Compile -> let m = Codegen.translate (Optimize.program fold ast) in
         				Llvm_analysis.assert_valid_module m;
         				print_string (Llvm.string_of_llmodule m)
  
@@ -90,6 +90,25 @@ Check() {
     Run "$LLI" "${basename}.ll" ">" "${basename}.out" &&
     Compare ${basename}.out ${reffile}.out ${basename}.diff
 
+    # Again with constant folding off, so that the shapes a test builds
+    # from literals are built by the program rather than the compiler
+
+    generatedfiles="$generatedfiles ${basename}.nofold.ll ${basename}.nofold.out" &&
+    Run "$SHAPE" "-nofold" "<" $1 ">" "${basename}.nofold.ll" &&
+    Run "$LLI" "${basename}.nofold.ll" ">" "${basename}.nofold.out" &&
+    Compare ${basename}.nofold.out ${reffile}.out ${basename}.nofold.diff
+
+    # A test may list commands, one per line in its .dead file, that the
+    # compiler should have optimized away: none may appear in the IR
+
+    if [ -f ${reffile}.dead ] && [ -f ${basename}.nofold.ll ] ; then
+	while read cmd ; do
+	    echo grep -F "\"$cmd\"" ${basename}.nofold.ll 1>&2
+	    ! grep -q -F -e "$cmd" ${basename}.nofold.ll ||
+		SignalError "${basename}.nofold.ll still runs $cmd"
+	done < ${reffile}.dead
+    fi
+
     # Report the status and clean up the generated files
 
     if [ $error -eq 0 ] ; then